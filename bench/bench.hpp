@@ -0,0 +1,71 @@
+#pragma once
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <functional>
+#include <string>
+#include <thread>
+#include <vector>
+
+/*
+    Tiny benchmark harness. Each source file in bench/ registers its cases with a static Benchmark and
+    main.cpp runs every case whose name contains the filter passed on the command line.
+*/
+class Benchmark {
+public:
+    typedef std::function<void()> Body;
+
+    Benchmark(const std::string& name, Body body) {
+        get_registry().push_back({ name, body });
+    }
+
+    static int run(const std::string& filter) {
+        for (auto& b : get_registry()) {
+            if (b.name.find(filter) == std::string::npos) {
+                continue;
+            }
+            printf("== %s\n", b.name.c_str());
+            b.body();
+        }
+        return 0;
+    }
+
+private:
+    struct Entry {
+        std::string name;
+        Body body;
+    };
+
+    static std::vector<Entry>& get_registry() {
+        static std::vector<Entry> registry;
+        return registry;
+    }
+};
+
+
+// Used to stop the optimizer from throwing away the work being measured.
+static volatile long long bench_sink = 0;
+
+
+// Run `f` `iterations` times and return the average time per iteration in nanoseconds.
+template <class F>
+double measure(std::size_t iterations, F f) {
+    auto start = std::chrono::high_resolution_clock::now();
+    for (std::size_t i = 0; i < iterations; ++i) {
+        f();
+    }
+    auto end = std::chrono::high_resolution_clock::now();
+    return std::chrono::duration<double, std::nano>(end - start).count() / (double)iterations;
+}
+
+
+// Thread counts for scaling benchmarks: powers of two up to the number of cores, then every core.
+inline std::vector<std::size_t> thread_counts() {
+    std::size_t cores = std::max(std::thread::hardware_concurrency(), 1u);
+    std::vector<std::size_t> counts;
+    for (std::size_t n = 1; n < cores; n *= 2) {
+        counts.push_back(n);
+    }
+    counts.push_back(cores);
+    return counts;
+}
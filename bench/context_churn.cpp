@@ -0,0 +1,106 @@
+#include <functional>
+#include <memory>
+#include <unordered_map>
+#include <unordered_set>
+#include <event.hpp>
+
+#include "bench.hpp"
+
+namespace {
+
+// The original hash based context/event pair, kept as the baseline for teardown cost.
+class HashContext;
+
+class HashEventBase {
+public:
+    virtual void unregister_context(HashContext* context) = 0;
+};
+
+class HashEvent : public HashEventBase {
+public:
+    void add(HashContext* context, std::function<void(int)> delegate) {
+        delegates[context] = delegate;
+    }
+
+    void unregister_context(HashContext* context) override {
+        delegates.erase(context);
+    }
+
+    std::unordered_map<HashContext*, std::function<void(int)>> delegates;
+};
+
+class HashContext {
+public:
+    ~HashContext() {
+        for (auto event : events) {
+            event->unregister_context(this);
+        }
+    }
+
+    void register_event(HashEvent& event, std::function<void(int)> delegate) {
+        event.add(this, delegate);
+        events.insert(&event);
+    }
+
+    std::unordered_set<HashEventBase*> events;
+};
+
+
+struct Widget : EventContext { };
+
+
+const std::size_t widgets = 10000;
+const std::size_t events_per_widget = 4;
+
+Benchmark context_churn("context_churn", []() {
+    // Simulates a screen change: every widget subscribes to a handful of window events and is then destroyed.
+    HashEvent hash_events[events_per_widget];
+    double hash_ns = measure(50, [&]() {
+        std::unique_ptr<HashContext[]> contexts(new HashContext[widgets]);
+        for (std::size_t i = 0; i < widgets; ++i) {
+            for (auto& e : hash_events) {
+                contexts[i].register_event(e, [](int v) { bench_sink += v; });
+            }
+        }
+    });
+
+    Event<int> events[events_per_widget];
+    double intrusive_ns = measure(50, [&]() {
+        std::unique_ptr<Widget[]> contexts(new Widget[widgets]);
+        for (std::size_t i = 0; i < widgets; ++i) {
+            for (auto& e : events) {
+                contexts[i].register_event(e, [](int v) { bench_sink += v; });
+            }
+        }
+    });
+
+    // Plain structs holding Connection handles instead of inheriting EventContext.
+    std::vector<Connection> connections(widgets * events_per_widget);
+    double handle_ns = measure(50, [&]() {
+        for (std::size_t i = 0; i < widgets; ++i) {
+            for (std::size_t e = 0; e < events_per_widget; ++e) {
+                connections[i * events_per_widget + e] = events[e].connect([](int v) { bench_sink += v; });
+            }
+        }
+        for (auto& c : connections) {
+            c.disconnect();
+        }
+    });
+
+    printf("create + destroy %zu contexts with %zu connections each:\n", widgets, events_per_widget);
+    printf("  hashed    %10.1f us\n  intrusive %10.1f us  (%.2fx)\n  handles   %10.1f us  (%.2fx)\n",
+           hash_ns / 1000.0, intrusive_ns / 1000.0, hash_ns / intrusive_ns, handle_ns / 1000.0, hash_ns / handle_ns);
+
+    // Moving a context only has to patch the head of its connection list.
+    std::vector<Widget> moved(1);
+    for (auto& e : events) {
+        moved[0].register_event(e, [](int v) { bench_sink += v; });
+    }
+    double move_ns = measure(1000000, [&]() {
+        Widget w(std::move(moved[0]));
+        moved[0] = std::move(w);
+    });
+    printf("  context move round trip %.1f ns\n", move_ns);
+});
+
+}
@@ -0,0 +1,61 @@
+#include <functional>
+#include <memory>
+#include <delegate.hpp>
+#include <event.hpp>
+
+#include "bench.hpp"
+
+namespace {
+
+const std::size_t subscriptions = 100000;
+
+
+// A capture that is bigger than the small object buffer of common std::function implementations.
+struct Capture {
+    long long* counter;
+    int a, b, c, d;
+};
+
+
+template <class D>
+void churn(std::vector<D>& delegates) {
+    for (std::size_t i = 0; i < subscriptions; ++i) {
+        Capture cap = { (long long*)&bench_sink, (int)i, 1, 2, 3 };
+        delegates.push_back([cap](int v) { *cap.counter += v + cap.a; });
+    }
+    for (auto& d : delegates) {
+        d(1);
+    }
+    delegates.clear();
+}
+
+
+struct Subscriber : EventContext { };
+
+Benchmark delegate_churn("delegate_churn", []() {
+    std::vector<std::function<void(int)>> functions;
+    functions.reserve(subscriptions);
+    double function_ns = measure(20, [&]() { churn(functions); });
+
+    std::vector<Delegate<void(int)>> delegates;
+    delegates.reserve(subscriptions);
+    double delegate_ns = measure(20, [&]() { churn(delegates); });
+
+    printf("register + dispatch + release of %zu subscriptions:\n", subscriptions);
+    printf("  std::function %12.1f us\n  Delegate      %12.1f us  (%.2fx)\n",
+           function_ns / 1000.0, delegate_ns / 1000.0, function_ns / delegate_ns);
+
+    // The same churn going through Event and EventContext end to end.
+    Event<int> event;
+    double event_ns = measure(20, [&]() {
+        std::unique_ptr<Subscriber[]> contexts(new Subscriber[subscriptions]);
+        for (std::size_t i = 0; i < subscriptions; ++i) {
+            Capture cap = { (long long*)&bench_sink, (int)i, 1, 2, 3 };
+            contexts[i].register_event(event, [cap](int v) { *cap.counter += v + cap.a; });
+        }
+        event(1);
+    });
+    printf("  Event         %12.1f us\n", event_ns / 1000.0);
+});
+
+}
@@ -0,0 +1,74 @@
+#include <algorithm>
+#include <functional>
+#include <memory>
+#include <unordered_map>
+#include <unordered_set>
+#include <event.hpp>
+
+#include "bench.hpp"
+
+namespace {
+
+// The previous hash map based Event, kept here as the baseline to compare dispatch against.
+template <class ...Args>
+class MapEvent {
+public:
+    typedef std::function<void(Args...)> Delegate;
+
+    void operator()(const Args&... args) {
+        for (auto& d : delegates) {
+            if (!remove.count(d.first)) {
+                d.second(args...);
+            }
+        }
+        for (auto c : remove) {
+            delegates.erase(c);
+        }
+        remove.clear();
+    }
+
+    void add(void* context, Delegate delegate) {
+        delegates[context] = delegate;
+    }
+
+private:
+    std::unordered_map<void*, Delegate> delegates;
+    std::unordered_set<void*> remove;
+};
+
+
+struct Subscriber : EventContext { };
+
+
+void run_dispatch(std::size_t subscribers) {
+    // Keep the total number of handler calls roughly constant between sizes.
+    std::size_t iterations = std::max<std::size_t>(10, 10000000 / subscribers);
+
+    std::vector<Subscriber> contexts(subscribers);
+
+    MapEvent<int> map_event;
+    for (auto& c : contexts) {
+        map_event.add(&c, [](int v) { bench_sink += v; });
+    }
+    double map_ns = measure(iterations, [&]() { map_event(1); });
+
+    Event<int> event;
+    for (auto& c : contexts) {
+        c.register_event(event, [](int v) { bench_sink += v; });
+    }
+    double slot_ns = measure(iterations, [&]() { event(1); });
+
+    printf("%8zu subscribers: map %12.1f ns/dispatch  slots %12.1f ns/dispatch  (%.2fx)\n",
+           subscribers, map_ns, slot_ns, map_ns / slot_ns);
+
+    // Tear the contexts down before the event so the unregister path is exercised as well.
+    contexts.clear();
+}
+
+Benchmark dispatch("event_dispatch", []() {
+    for (std::size_t n : { 1, 10, 1000, 100000 }) {
+        run_dispatch(n);
+    }
+});
+
+}
@@ -0,0 +1,8 @@
+#include <string>
+#include <SDL.h>
+
+#include "bench.hpp"
+
+int main(int argc, char** argv) {
+    return Benchmark::run(argc > 1 ? argv[1] : "");
+}
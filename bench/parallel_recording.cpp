@@ -0,0 +1,77 @@
+#include <cmath>
+#include <string>
+#include <vector>
+#include <record_pool.hpp>
+
+#include "bench.hpp"
+
+namespace {
+
+const int panel_count = 4000;
+const int frames = 50;
+
+// A panel of an editor view: frame, title, a small plot and a column of labelled rows.
+void record_panel(std::size_t index, DisplayList& list) {
+    glm::vec2 pos = { (index % 80) * 130.0f, (index / 80) * 110.0f };
+
+    list.push_state();
+    list.translate(pos);
+    list.begin_path();
+    list.rounded_rect({ 0, 0 }, { 120, 100 }, 4);
+    list.fill({ 0.95f, 0.95f, 0.95f, 1.0f });
+    list.stroke({ 0.3f, 0.3f, 0.3f, 1.0f }, 1.0f);
+
+    list.set_font("regular", 12);
+    list.text({ 6, 4 }, "Panel " + std::to_string(index), { 0, 0, 0, 1 }, Align::top | Align::left);
+
+    list.begin_path();
+    list.move_to({ 6, 60 });
+    for (int i = 1; i <= 54; ++i) {
+        list.line_to({ 6 + i * 2.0f, 60 - 20 * std::sin((index + i) * 0.2f) });
+    }
+    list.stroke({ 0.1f, 0.4f, 0.8f, 1.0f }, 1.5f);
+
+    for (int i = 0; i < 4; ++i) {
+        list.begin_path();
+        list.circle({ 10, 72 + i * 7.0f }, 2);
+        list.fill({ 0.2f, 0.6f, 0.2f, 1.0f });
+        list.text({ 16, 72 + i * 7.0f }, "value", { 0, 0, 0, 1 }, Align::middle | Align::left);
+    }
+    list.pop_state();
+}
+
+Benchmark parallel_recording("parallel_recording", []() {
+    std::vector<std::size_t> counts = thread_counts();
+
+    RecordPool pool(1);
+    DisplayList frame;
+    double single = 0.0;
+
+    // Merging into one list runs on a single thread whatever the pool size, it is timed apart so it doesn't hide the recording speedup.
+    printf("%d panels recorded and merged per frame, %d frames:\n", panel_count, frames);
+    for (std::size_t threads : counts) {
+        pool.set_threads(threads);
+
+        // One untimed frame so every list has grown to its panel.
+        pool.record(panel_count, record_panel);
+
+        double record_ns = measure(frames, [&]() {
+            pool.record(panel_count, record_panel);
+            bench_sink += pool.size();
+        });
+
+        double merge_ns = measure(frames, [&]() {
+            frame.clear();
+            pool.merge(frame);
+            bench_sink += frame.size();
+        });
+
+        if (threads == 1) {
+            single = record_ns;
+        }
+        printf("  %2zu threads  record %8.3f ms/frame  %5.2fx  merge %8.3f ms/frame  (%zu commands, %zu KB)\n", threads,
+               record_ns / 1e6, single / record_ns, merge_ns / 1e6, frame.size(), frame.get_bytes() / 1024);
+    }
+});
+
+}
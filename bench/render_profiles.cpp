@@ -0,0 +1,62 @@
+#include <algorithm>
+#include <vector>
+#include <window.hpp>
+
+#include "bench.hpp"
+#include "scene.hpp"
+
+namespace {
+
+const int warmup_frames = 30;
+const int measured_frames = 300;
+const glm::ivec2 resolution = { 1280, 720 };
+
+Benchmark render_profiles("render_profiles", []() {
+    Window window;
+    if (!window.create("Render profiles", resolution.x, resolution.y, false, RenderProfile::performance)) {
+        printf("  skipped, no GL context\n");
+        return;
+    }
+    window.set_pacing(Pacing::unlimited);
+    window.set_background({ 0.8f, 0.8f, 0.8f, 1.0f });
+
+    // Run from bin/ to include text, the font is loaded again with every profile switch.
+    Font font = window.get_canvas().load_font("regular", "OpenSans-Regular.ttf");
+
+    printf("%d frames of %dx%d, GPU work finished every frame:\n", measured_frames, resolution.x, resolution.y);
+    for (RenderProfile profile : { RenderProfile::performance, RenderProfile::balanced, RenderProfile::quality }) {
+        if (!window.set_render_profile(profile)) {
+            continue;
+        }
+
+        std::vector<double> frame_ms;
+        for (int i = 0; i < warmup_frames + measured_frames; ++i) {
+            Uint64 start = SDL_GetPerformanceCounter();
+
+            window.process_events();
+            window.begin_frame();
+            draw_scene(window.get_canvas(), resolution, font, i);
+            window.end_frame();
+            glFinish();
+
+            if (i >= warmup_frames) {
+                frame_ms.push_back((SDL_GetPerformanceCounter() - start) * 1000.0 / SDL_GetPerformanceFrequency());
+            }
+        }
+
+        std::sort(frame_ms.begin(), frame_ms.end());
+        double mean = 0.0;
+        for (double ms : frame_ms) {
+            mean += ms;
+        }
+        mean /= frame_ms.size();
+
+        RenderSettings settings = RenderSettings::get(profile);
+        printf("  %-12s %dx MSAA  mean %7.3f ms  p50 %7.3f ms  p95 %7.3f ms\n", to_string(profile), settings.msaa_samples,
+               mean, frame_ms[frame_ms.size() / 2], frame_ms[frame_ms.size() * 95 / 100]);
+    }
+
+    window.close();
+});
+
+}
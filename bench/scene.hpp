@@ -0,0 +1,31 @@
+#pragma once
+#include <cmath>
+#include <canvas.hpp>
+
+// Overlapping translucent panels, curves, strokes and text, roughly a busy editor frame. Shared by the GPU and CPU render benchmarks.
+inline void draw_scene(Canvas& canvas, const glm::ivec2& size, Font font, int frame) {
+    for (int i = 0; i < 200; ++i) {
+        float t = frame * 0.01f + i;
+        glm::vec2 pos = { (std::sin(t * 0.7f) * 0.5f + 0.5f) * (size.x - 120), (std::cos(t * 0.3f) * 0.5f + 0.5f) * (size.y - 80) };
+
+        canvas.begin_path();
+        canvas.rounded_rect(pos, { 120, 80 }, 6);
+        canvas.fill({ 0.2f + (i % 5) * 0.15f, 0.4f, 0.8f - (i % 3) * 0.2f, 0.5f });
+        canvas.stroke({ 0.0f, 0.0f, 0.0f, 0.8f }, 1.5f);
+    }
+
+    for (int i = 0; i < 50; ++i) {
+        float y = (i + 0.5f) * size.y / 50.0f;
+        canvas.begin_path();
+        canvas.move_to({ 0, y });
+        canvas.bezier_to({ size.x * 0.3f, y - 40 }, { size.x * 0.6f, y + 40 }, { (float)size.x, y });
+        canvas.stroke({ 0.1f, 0.1f, 0.1f, 0.6f }, 2.0f);
+    }
+
+    if (font >= 0) {
+        canvas.set_font(font, 16);
+        for (int i = 0; i < 40; ++i) {
+            canvas.text({ 10, 10 + i * 18.0f }, "The quick brown fox jumps over the lazy dog", { 0, 0, 0, 1 }, Align::top | Align::left);
+        }
+    }
+}
@@ -0,0 +1,66 @@
+#include <vector>
+#include <software_renderer.hpp>
+
+#include "bench.hpp"
+#include "scene.hpp"
+
+namespace {
+
+const int frames = 30;
+const glm::ivec2 resolution = { 1280, 720 };
+
+// The render_profiles scene over a gradient backdrop.
+void draw_backdrop_scene(Canvas& canvas, Font font, int frame) {
+    canvas.begin_path();
+    canvas.rect({ 0, 0 }, glm::vec2(resolution));
+    canvas.fill(canvas.linear_gradient({ 0, 0 }, { 0, (float)resolution.y }, { 0.9f, 0.9f, 0.95f, 1.0f }, { 0.6f, 0.65f, 0.75f, 1.0f }));
+
+    draw_scene(canvas, resolution, font, frame);
+}
+
+// FNV-1a of the frame, the same on every thread count.
+std::uint32_t checksum(const std::vector<unsigned char>& pixels) {
+    std::uint32_t hash = 2166136261u;
+    for (unsigned char c : pixels) {
+        hash = (hash ^ c) * 16777619u;
+    }
+    return hash;
+}
+
+Benchmark software_render("software_render", []() {
+    SoftwareRenderer renderer(1);
+    if (!renderer.create(resolution.x, resolution.y)) {
+        return;
+    }
+    renderer.set_background({ 1, 1, 1, 1 });
+
+    // Run from bin/ to include text.
+    Font font = renderer.get_canvas().load_font("regular", "OpenSans-Regular.ttf");
+
+    std::vector<std::size_t> counts = thread_counts();
+
+    // Every thread count draws the same frames, so each must end on the single threaded checksum.
+    printf("%d frames of %dx%d on the CPU:\n", frames, resolution.x, resolution.y);
+    double single = 0.0;
+    std::uint32_t expected = 0;
+    for (std::size_t threads : counts) {
+        renderer.set_threads(threads);
+
+        int frame = 0;
+        double ns = measure(frames, [&]() {
+            renderer.begin_frame();
+            draw_backdrop_scene(renderer.get_canvas(), font, frame++);
+            renderer.end_frame();
+        });
+
+        std::uint32_t sum = checksum(renderer.get_pixels());
+        if (threads == 1) {
+            single = ns;
+            expected = sum;
+        }
+        printf("  %2zu threads  %8.3f ms/frame  %5.2fx  checksum %08x%s\n", threads, ns / 1e6, single / ns, sum,
+               sum == expected ? "" : "  MISMATCH, differs from 1 thread");
+    }
+});
+
+}
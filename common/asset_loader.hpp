@@ -0,0 +1,154 @@
+#pragma once
+#include <condition_variable>
+#include <cstdio>
+#include <deque>
+#include <fstream>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "event_queue.hpp"
+
+// Contents of a loaded file, kept alive for as long as anything (e.g. a nanovg font) still reads from it.
+typedef std::shared_ptr<const std::vector<unsigned char>> AssetData;
+
+
+/*
+    Reads files on a worker thread so large assets (fonts, images) don't hold up the first
+    frame. Finished loads are posted to EventQueue::main() and their callbacks run on the main
+    thread when the window drains it, waking it up if it was idle. The thread starts with the
+    first load.
+*/
+class AssetLoader {
+public:
+
+    AssetLoader() { }
+
+    AssetLoader(const AssetLoader&) = delete;
+    void operator=(const AssetLoader&) = delete;
+
+    ~AssetLoader() {
+        stop();
+    }
+
+    // Reads `filename` in the background, `done` gets its contents on the main thread, or null if it couldn't be read.
+    void load(const std::string& filename, const std::function<void(AssetData)>& done) {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            jobs.push_back({ filename, done });
+            ++pending;
+            running = true;
+        }
+        if (!thread.joinable()) {
+            thread = std::thread([this]() { run(); });
+        }
+        wake.notify_all();
+    }
+
+    // Loads requested but not delivered yet.
+    std::size_t get_pending() const {
+        std::lock_guard<std::mutex> lock(mutex);
+        return pending;
+    }
+
+    // Blocks until every requested load is read, then delivers them all. Main thread only.
+    void finish() {
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            idle.wait(lock, [&]() { return jobs.empty() && !reading; });
+        }
+        EventQueue::main().drain();
+    }
+
+    // Abandons queued loads and drops the ones already read but not delivered. Main thread only.
+    void stop() {
+        if (thread.joinable()) {
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                running = false;
+                jobs.clear();
+            }
+            wake.notify_all();
+            thread.join();
+        }
+        EventQueue::main().discard(this);
+
+        std::lock_guard<std::mutex> lock(mutex);
+        pending = 0;
+    }
+
+private:
+
+    struct Job {
+        std::string filename;
+        std::function<void(AssetData)> done;
+    };
+
+    struct Loaded : EventQueue::Node {
+        Loaded(AssetLoader* loader, Job&& job, AssetData data) : loader(loader), job(std::move(job)), data(data) {
+            target = loader;
+        }
+
+        void deliver() override {
+            {
+                std::lock_guard<std::mutex> lock(loader->mutex);
+                --loader->pending;
+            }
+            if (!data) {
+                printf("Error loading asset '%s'\n", job.filename.c_str());
+            }
+            job.done(data);
+        }
+
+        AssetLoader* loader;
+        Job job;
+        AssetData data;
+    };
+
+    static AssetData read(const std::string& filename) {
+        std::ifstream in(filename, std::ios::binary | std::ios::ate);
+        if (!in) {
+            return nullptr;
+        }
+
+        auto data = std::make_shared<std::vector<unsigned char>>((std::size_t)in.tellg());
+        in.seekg(0);
+        if (!in.read(reinterpret_cast<char*>(data->data()), data->size())) {
+            return nullptr;
+        }
+        return data;
+    }
+
+    void run() {
+        std::unique_lock<std::mutex> lock(mutex);
+        while (true) {
+            wake.wait(lock, [&]() { return !running || !jobs.empty(); });
+            if (!running) {
+                break;
+            }
+
+            Job job = std::move(jobs.front());
+            jobs.pop_front();
+            reading = true;
+            lock.unlock();
+
+            AssetData data = read(job.filename);
+            EventQueue::main().push(new Loaded(this, std::move(job), data));
+
+            lock.lock();
+            reading = false;
+            idle.notify_all();
+        }
+    }
+
+    std::thread thread;
+    mutable std::mutex mutex;
+    std::condition_variable wake, idle;
+
+    std::deque<Job> jobs;
+    std::size_t pending = 0;
+    bool running = false, reading = false;
+};
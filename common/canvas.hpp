@@ -1,5 +1,14 @@
 #pragma once
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <functional>
+#include <memory>
+#include <set>
 #include <string>
+#include <vector>
 #include <nanovg.h>
 #include <glm/glm.hpp>
 
@@ -7,6 +16,12 @@
 
 typedef int Font;
 
+// Where a font loaded through a Canvas came from, `data` is set for fonts loaded from memory.
+struct FontSource {
+    std::string name, filename;
+    std::shared_ptr<const std::vector<unsigned char>> data;
+};
+
 typedef NVGpaint Paint;
 
 struct Color {
@@ -105,181 +120,440 @@ static void from_json(const json& j, Align& a) {
     }
 }
 
+class Canvas;
+
+// Keeps rendered layers for Canvas::layer, implemented by LayerCache.
+class LayerProvider {
+public:
+    // The image holding `key` at `pixels`, redrawn with `draw` when missing or not at `version`. 0 if it can't be cached.
+    virtual int get_layer(const std::string& key, const glm::ivec2& pixels, std::uint64_t version,
+                          const glm::vec2& size, const std::function<void(Canvas&)>& draw) = 0;
+
+protected:
+    ~LayerProvider() { }
+};
+
+
 class Canvas {
 public:
 
-    Canvas(NVGcontext* ctx = nullptr) : ctx(ctx) {}
+    Canvas(NVGcontext* ctx = nullptr) : state(std::make_shared<State>()) {
+        state->ctx = ctx;
+    }
 
 
     void begin_frame(const glm::ivec2& resolution, float pixel_ratio = 1.0f) {
-        nvgBeginFrame(ctx, resolution.x, resolution.y, pixel_ratio);
+        nvgBeginFrame(state->ctx, resolution.x, resolution.y, pixel_ratio);
+        state->pixel_ratio = pixel_ratio;
+        state->clip = Clip();
+        state->saved_clips.clear();
     }
 
     void end_frame() {
-        nvgEndFrame(ctx);
+        nvgEndFrame(state->ctx);
     }
 
     NVGcontext* get_context() {
-        return ctx;
+        return state->ctx;
+    }
+
+    // Moves every copy of this canvas over to `ctx` and loads the fonts again, with the same ids.
+    void set_context(NVGcontext* ctx) {
+        state->ctx = ctx;
+        state->deferred.clear();
+        if (!ctx) {
+            return;
+        }
+
+        std::vector<FontSource> fonts;
+        std::swap(fonts, state->fonts);
+
+        for (auto& font : fonts) {
+            if (font.data) {
+                load_font(font.name, font.data, font.filename);
+            } else {
+                load_font(font.name, font.filename);
+            }
+        }
     }
 
     // State operations
 
     void push_state() {
-        nvgSave(ctx);
+        nvgSave(state->ctx);
+        state->saved_clips.push_back(state->clip);
     }
 
     void pop_state() {
-        nvgRestore(ctx);
+        nvgRestore(state->ctx);
+        if (!state->saved_clips.empty()) {
+            state->clip = state->saved_clips.back();
+            state->saved_clips.pop_back();
+        }
     }
 
     // Font operations
 
 
     Font load_font(const std::string& name, const std::string& filename) {
-        return nvgCreateFont(ctx, name.c_str(), filename.c_str());
+        state->fonts.push_back({ name, filename, nullptr });
+        state->pending_fonts.erase(name);
+        return nvgCreateFont(state->ctx, name.c_str(), filename.c_str());
+    }
+
+    // nanovg reads the font straight out of `data`, which is kept alive with the canvas.
+    Font load_font(const std::string& name, const std::shared_ptr<const std::vector<unsigned char>>& data, const std::string& filename = "") {
+        state->fonts.push_back({ name, filename, data });
+        state->pending_fonts.erase(name);
+        return nvgCreateFontMem(state->ctx, name.c_str(), const_cast<unsigned char*>(data->data()), (int)data->size(), 0);
+    }
+
+    // Every font loaded through this canvas, in order.
+    const std::vector<FontSource>& get_fonts() const {
+        return state->fonts;
+    }
+
+    // Loads the fonts `source` has and this canvas doesn't yet, in the same order so the ids match.
+    void sync_fonts(const Canvas& source) {
+        auto& fonts = source.state->fonts;
+        while (state->fonts.size() < fonts.size()) {
+            auto& font = fonts[state->fonts.size()];
+            if (font.data) {
+                load_font(font.name, font.data, font.filename);
+            } else {
+                load_font(font.name, font.filename);
+            }
+        }
+        state->pending_fonts = source.state->pending_fonts;
+        state->placeholder = source.state->placeholder;
+    }
+
+    // Marks a font as on its way, text set in it uses the placeholder font until it is loaded.
+    void add_pending_font(const std::string& name) {
+        state->pending_fonts.insert(name);
+    }
+
+    bool has_pending_fonts() const {
+        return !state->pending_fonts.empty();
+    }
+
+    // The placeholder has to be loaded already, a pending one would leave text with no font at all.
+    bool set_placeholder_font(const std::string& name) {
+        if (state->pending_fonts.count(name)) {
+            printf("Placeholder font '%s' is still loading\n", name.c_str());
+            return false;
+        }
+        state->placeholder = name;
+        return true;
     }
 
     void set_font(Font font, float size) {
-        nvgFontFaceId(ctx, font);
+        nvgFontFaceId(state->ctx, font);
+        state->font = font;
         font_size(size);
     }
 
     void set_font(const std::string& name, float size) {
-        nvgFontFace(ctx, name.c_str());
+        const std::string& face = state->pending_fonts.count(name) ? state->placeholder : name;
+        nvgFontFace(state->ctx, face.c_str());
+        state->font = nvgFindFont(state->ctx, face.c_str());
         font_size(size);
     }
 
     void font_size(float size) {
-        nvgFontSize(ctx, size);
+        nvgFontSize(state->ctx, size);
+        state->size = size;
     }
 
 
     // Text rendering operations
 
     void text_bounds(const glm::vec2& pos, const std::string& text, glm::vec2& min, glm::vec2 max, Align align) {
-        nvgTextAlign(ctx, static_cast<int>(align));
+        nvgTextAlign(state->ctx, static_cast<int>(align));
         float bounds[4];
-        nvgTextBounds(ctx, pos.x, pos.y, text.c_str(), nullptr, bounds);
+        nvgTextBounds(state->ctx, pos.x, pos.y, text.c_str(), nullptr, bounds);
         min = { bounds[0], bounds[1] };
         min = { bounds[2], bounds[3] };
     }
 
     void text(const glm::vec2& pos, const std::string& text, const Color& color, Align align) {
-        nvgTextAlign(ctx, static_cast<int>(align));
-        nvgFillColor(ctx, color.c);
-        nvgText(ctx, pos.x, pos.y, text.c_str(), nullptr);
+        this->text(pos, text.data(), text.data() + text.size(), color, align);
+    }
+
+    // The characters from `begin` up to `end`, which need not be null terminated.
+    void text(const glm::vec2& pos, const char* begin, const char* end, const Color& color, Align align) {
+        if (state->deferring) {
+            DeferredText t = { pos, std::string(begin, end), color, align, state->font, state->size, {}, state->clip };
+            nvgCurrentTransform(state->ctx, t.transform);
+            state->deferred.push_back(t);
+            return;
+        }
+
+        nvgTextAlign(state->ctx, static_cast<int>(align));
+        nvgFillColor(state->ctx, color.c);
+        nvgText(state->ctx, pos.x, pos.y, begin, end);
+    }
+
+    // While deferring, text is queued instead of drawn, and only comes out in draw_deferred_text on top of everything else.
+    void defer_text(bool enabled) {
+        state->deferring = enabled;
+    }
+
+    void draw_deferred_text() {
+        push_state();
+        for (auto& t : state->deferred) {
+            // The scissor goes back on in its own space, the text is clipped where it would have been.
+            if (t.clip.extent[0] < 0.0f) {
+                nvgResetScissor(state->ctx);
+            } else {
+                const float* m = t.clip.xform;
+                nvgResetTransform(state->ctx);
+                nvgTransform(state->ctx, m[0], m[1], m[2], m[3], m[4], m[5]);
+                nvgScissor(state->ctx, -t.clip.extent[0], -t.clip.extent[1], t.clip.extent[0] * 2.0f, t.clip.extent[1] * 2.0f);
+            }
+
+            nvgResetTransform(state->ctx);
+            nvgTransform(state->ctx, t.transform[0], t.transform[1], t.transform[2], t.transform[3], t.transform[4], t.transform[5]);
+            if (t.font >= 0) {
+                nvgFontFaceId(state->ctx, t.font);
+            }
+            nvgFontSize(state->ctx, t.size);
+            nvgTextAlign(state->ctx, static_cast<int>(t.align));
+            nvgFillColor(state->ctx, t.color.c);
+            nvgText(state->ctx, t.pos.x, t.pos.y, t.text.c_str(), nullptr);
+        }
+        pop_state();
+        state->deferred.clear();
     }
 
 
     // Gradient operations
 
     Color linear_gradient(const glm::vec2& p_start, const glm::vec2& p_end, const Color& c_start, const Color& c_end) {
-        return nvgLinearGradient(ctx, p_start.x, p_start.y, p_end.x, p_end.y, c_start.c, c_end.c);
+        return nvgLinearGradient(state->ctx, p_start.x, p_start.y, p_end.x, p_end.y, c_start.c, c_end.c);
     }
 
     Color box_gradient(const glm::vec2& p_start, const glm::vec2& size, const Color& c_start, const Color& c_end, float radius, float feather) {
-        return nvgBoxGradient(ctx, p_start.x, p_start.y, size.x, size.y, radius, feather, c_start.c, c_end.c);
+        return nvgBoxGradient(state->ctx, p_start.x, p_start.y, size.x, size.y, radius, feather, c_start.c, c_end.c);
     }
 
     Color radial_gradient(const glm::vec2& p, float start, float end, const Color& c_start, const Color& c_end) {
-        return nvgRadialGradient(ctx, p.x, p.y, start, end, c_start.c, c_end.c);
+        return nvgRadialGradient(state->ctx, p.x, p.y, start, end, c_start.c, c_end.c);
+    }
+
+    Color image_pattern(const glm::vec2& pos, const glm::vec2& size, int image, float alpha = 1.0f) {
+        return nvgImagePattern(state->ctx, pos.x, pos.y, size.x, size.y, 0.0f, image, alpha);
+    }
+
+
+    // Layer operations
+
+    void set_layer_provider(LayerProvider* provider) {
+        state->layers = provider;
+    }
+
+    /*
+        Draws a subtree through a cached layer: `draw` renders it into a texture of `size`
+        (with its origin at 0, 0) only when the layer is missing or `version` changed, and
+        the texture is drawn at `pos` after that. Without a cache `draw` runs in place.
+    */
+    void layer(const std::string& key, const glm::vec2& pos, const glm::vec2& size, std::uint64_t version, const std::function<void(Canvas&)>& draw) {
+        glm::ivec2 pixels = glm::ivec2(glm::ceil(size * state->pixel_ratio));
+        int image = state->layers ? state->layers->get_layer(key, pixels, version, size, draw) : 0;
+
+        if (!image) {
+            push_state();
+            translate(pos);
+            draw(*this);
+            pop_state();
+            return;
+        }
+
+        begin_path();
+        rect(pos, size);
+        fill(image_pattern(pos, size, image));
+    }
+
+
+    // Scissor operations, the scissor follows the current transform
+
+    void scissor(const glm::vec2& pos, const glm::vec2& size) {
+        nvgScissor(state->ctx, pos.x, pos.y, size.x, size.y);
+
+        // Kept the way nanovg keeps it, which has no getter for it.
+        float m[6];
+        nvgCurrentTransform(state->ctx, m);
+        nvgTransformIdentity(state->clip.xform);
+        state->clip.xform[4] = pos.x + std::max(size.x, 0.0f) * 0.5f;
+        state->clip.xform[5] = pos.y + std::max(size.y, 0.0f) * 0.5f;
+        nvgTransformMultiply(state->clip.xform, m);
+        state->clip.extent[0] = std::max(size.x, 0.0f) * 0.5f;
+        state->clip.extent[1] = std::max(size.y, 0.0f) * 0.5f;
+    }
+
+    // Intersects with the current scissor's bounding box in the current space, as nvgIntersectScissor does.
+    void intersect_scissor(const glm::vec2& pos, const glm::vec2& size) {
+        if (state->clip.extent[0] < 0.0f) {
+            scissor(pos, size);
+            return;
+        }
+
+        // The old scissor in the current space.
+        float m[6], current[6], inverse[6];
+        std::memcpy(m, state->clip.xform, sizeof(m));
+        nvgCurrentTransform(state->ctx, current);
+        nvgTransformInverse(inverse, current);
+        nvgTransformMultiply(m, inverse);
+
+        float ex = state->clip.extent[0], ey = state->clip.extent[1];
+        glm::vec2 half = { ex * std::abs(m[0]) + ey * std::abs(m[2]), ex * std::abs(m[1]) + ey * std::abs(m[3]) };
+        glm::vec2 lo = glm::max(glm::vec2(m[4], m[5]) - half, pos);
+        glm::vec2 hi = glm::min(glm::vec2(m[4], m[5]) + half, pos + size);
+        scissor(lo, glm::max(hi - lo, glm::vec2(0.0f)));
+    }
+
+    void reset_scissor() {
+        nvgResetScissor(state->ctx);
+        state->clip = Clip();
     }
 
 
     // Transform operations
 
     void reset_transform() {
-        nvgResetTransform(ctx);
+        nvgResetTransform(state->ctx);
+    }
+
+    // Premultiplies the current transform by the 2x3 matrix `m`, laid out as nanovg's a, b, c, d, e, f.
+    void transform(const float* m) {
+        nvgTransform(state->ctx, m[0], m[1], m[2], m[3], m[4], m[5]);
     }
 
     void translate(const glm::vec2& p) {
-        nvgTranslate(ctx, p.x, p.y);
+        nvgTranslate(state->ctx, p.x, p.y);
     }
 
     void rotate(float r) {
-        nvgRotate(ctx, r);
+        nvgRotate(state->ctx, r);
     }
 
     void scale(const glm::vec2& s) {
-        nvgScale(ctx, s.x, s.y);
+        nvgScale(state->ctx, s.x, s.y);
     }
 
 
     // Path operations
 
     void begin_path() {
-        nvgBeginPath(ctx);
+        nvgBeginPath(state->ctx);
     }
 
     void move_to(const glm::vec2& pos) {
-        nvgMoveTo(ctx, pos.x, pos.y);
+        nvgMoveTo(state->ctx, pos.x, pos.y);
     }
 
     void line_to(const glm::vec2& pos) {
-        nvgLineTo(ctx, pos.x, pos.y);
+        nvgLineTo(state->ctx, pos.x, pos.y);
     }
 
     void bezier_to(const glm::vec2& c1, const glm::vec2& c2, const glm::vec2& pos) {
-        nvgBezierTo(ctx, c1.x, c1.y, c2.x, c2.y, pos.x, pos.y);
+        nvgBezierTo(state->ctx, c1.x, c1.y, c2.x, c2.y, pos.x, pos.y);
     }
 
     void quad_to(const glm::vec2& c, const glm::vec2& pos) {
-        nvgQuadTo(ctx, c.x, c.y, pos.x, pos.y);
+        nvgQuadTo(state->ctx, c.x, c.y, pos.x, pos.y);
     }
 
     void arc_to(const glm::vec2& p1, const glm::vec2& p2, float r) {
-        nvgArcTo(ctx, p1.x, p1.y, p2.x, p2.y, r);
+        nvgArcTo(state->ctx, p1.x, p1.y, p2.x, p2.y, r);
     }
 
     void close_path() {
-        nvgClosePath(ctx);
+        nvgClosePath(state->ctx);
     }
 
     void path_winding(int dir) {
-        nvgPathWinding(ctx, dir);
+        nvgPathWinding(state->ctx, dir);
     }
 
     void arc(const glm::vec2& pos, float r, float a0, float a1, int dir) {
-        nvgArc(ctx, pos.x, pos.y, r, a0, a1, dir);
+        nvgArc(state->ctx, pos.x, pos.y, r, a0, a1, dir);
     }
 
     void rect(const glm::vec2& pos, const glm::vec2& size) {
-        nvgRect(ctx, pos.x, pos.y, size.x, size.y);
+        nvgRect(state->ctx, pos.x, pos.y, size.x, size.y);
     }
 
     void rounded_rect(const glm::vec2& pos, const glm::vec2& size, float r) {
-        nvgRoundedRect(ctx, pos.x, pos.y, size.x, size.y, r);
+        nvgRoundedRect(state->ctx, pos.x, pos.y, size.x, size.y, r);
     }
 
     void ellipse(const glm::vec2& pos, const glm::vec2& radius) {
-        nvgEllipse(ctx, pos.x, pos.y, radius.x, radius.y);
+        nvgEllipse(state->ctx, pos.x, pos.y, radius.x, radius.y);
     }
 
     void circle(const glm::vec2& pos, float radius) {
-        nvgCircle(ctx, pos.x, pos.y, radius);
+        nvgCircle(state->ctx, pos.x, pos.y, radius);
     }
 
     void fill(const Color& color) {
         if (color.solid) {
-            nvgFillColor(ctx, color.c);
+            nvgFillColor(state->ctx, color.c);
         } else {
-            nvgFillPaint(ctx, color.paint);
+            nvgFillPaint(state->ctx, color.paint);
         }
-        nvgFill(ctx);
+        nvgFill(state->ctx);
     }
 
     void stroke(const Color& color, float width) {
         if (color.solid) {
-            nvgStrokeColor(ctx, color.c);
+            nvgStrokeColor(state->ctx, color.c);
         } else {
-            nvgStrokePaint(ctx, color.paint);
+            nvgStrokePaint(state->ctx, color.paint);
         }
-        nvgStrokeWidth(ctx, width);
-        nvgStroke(ctx);
+        nvgStrokeWidth(state->ctx, width);
+        nvgStroke(state->ctx);
     }
 
 
 private:
-    NVGcontext* ctx;
+    // The scissor as nanovg stores it, a transform to its centre and half its size. No scissor has a negative extent.
+    struct Clip {
+        float xform[6] = { 1.0f, 0.0f, 0.0f, 1.0f, 0.0f, 0.0f };
+        float extent[2] = { -1.0f, -1.0f };
+    };
+
+    struct DeferredText {
+        glm::vec2 pos;
+        std::string text;
+        Color color;
+        Align align;
+        Font font;
+        float size;
+        float transform[6];
+        Clip clip;
+    };
+
+    // Shared between copies of a Canvas, they all draw into the same context.
+    struct State {
+        NVGcontext* ctx = nullptr;
+
+        Font font = -1;
+        float size = 16.0f;
+        float pixel_ratio = 1.0f;
+
+        bool deferring = false;
+        std::vector<DeferredText> deferred;
+
+        Clip clip;
+        std::vector<Clip> saved_clips;
+
+        std::vector<FontSource> fonts;
+        std::set<std::string> pending_fonts;
+        std::string placeholder;
+
+        LayerProvider* layers = nullptr;
+    };
+
+    std::shared_ptr<State> state;
 };
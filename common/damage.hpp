@@ -0,0 +1,135 @@
+#pragma once
+#include <algorithm>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+// A damaged area in whole window pixels, `max` exclusive.
+struct DamageRect {
+    glm::ivec2 min, max;
+
+    glm::ivec2 get_size() const {
+        return max - min;
+    }
+
+    long long get_area() const {
+        return (long long)(max.x - min.x) * (max.y - min.y);
+    }
+
+    bool intersects(const glm::vec2& lo, const glm::vec2& hi) const {
+        return lo.x < max.x && hi.x > min.x && lo.y < max.y && hi.y > min.y;
+    }
+
+    bool intersects(const DamageRect& r) const {
+        return r.min.x < max.x && r.max.x > min.x && r.min.y < max.y && r.max.y > min.y;
+    }
+
+    DamageRect merge(const DamageRect& r) const {
+        return { glm::min(min, r.min), glm::max(max, r.max) };
+    }
+};
+
+
+/*
+    Collects the rectangles invalidated since the last frame and keeps them merged into a
+    handful of regions. Rectangles are joined when they overlap or when the union wastes
+    little area, and once the damage covers most of the window it is simply all of it.
+*/
+class DamageTracker {
+public:
+
+    void set_bounds(const glm::ivec2& size) {
+        if (size != bounds) {
+            bounds = size;
+            add_all();
+        }
+    }
+
+    // Rounds out to whole pixels and clips to the window.
+    void add(const glm::vec2& min, const glm::vec2& max) {
+        DamageRect r = {
+            glm::max(glm::ivec2(glm::floor(min)), glm::ivec2(0)),
+            glm::min(glm::ivec2(glm::ceil(max)), bounds)
+        };
+        if (full || r.max.x <= r.min.x || r.max.y <= r.min.y) {
+            return;
+        }
+
+        // Absorb every region the new one overlaps or sits close to, the union may then reach further ones.
+        for (std::size_t i = 0; i < regions.size();) {
+            if (regions[i].intersects(r) || waste(regions[i], r) <= merge_slack) {
+                r = r.merge(regions[i]);
+                regions.erase(regions.begin() + i);
+                i = 0;
+            } else {
+                ++i;
+            }
+        }
+        regions.push_back(r);
+
+        while (regions.size() > max_regions) {
+            merge_cheapest();
+        }
+
+        long long area = 0;
+        for (auto& region : regions) {
+            area += region.get_area();
+        }
+        if (area * 2 > (long long)bounds.x * bounds.y) {
+            add_all();
+        }
+    }
+
+    void add_all() {
+        regions.assign(1, { glm::ivec2(0), bounds });
+        full = true;
+    }
+
+    void clear() {
+        regions.clear();
+        full = false;
+    }
+
+    bool empty() const {
+        return regions.empty();
+    }
+
+    bool is_full() const {
+        return full;
+    }
+
+    const std::vector<DamageRect>& get_regions() const {
+        return regions;
+    }
+
+private:
+
+    static const std::size_t max_regions = 4;
+    static const long long merge_slack = 64 * 64;
+
+    // Area the union of `a` and `b` covers that neither of them does (ignoring their overlap).
+    static long long waste(const DamageRect& a, const DamageRect& b) {
+        return a.merge(b).get_area() - a.get_area() - b.get_area();
+    }
+
+    void merge_cheapest() {
+        std::size_t best_a = 0, best_b = 1;
+        long long best = waste(regions[0], regions[1]);
+        for (std::size_t a = 0; a < regions.size(); ++a) {
+            for (std::size_t b = a + 1; b < regions.size(); ++b) {
+                long long w = waste(regions[a], regions[b]);
+                if (w < best) {
+                    best = w;
+                    best_a = a;
+                    best_b = b;
+                }
+            }
+        }
+        regions[best_a] = regions[best_a].merge(regions[best_b]);
+        regions.erase(regions.begin() + best_b);
+    }
+
+    glm::ivec2 bounds{ 0 };
+    std::vector<DamageRect> regions;
+    bool full = false;
+};
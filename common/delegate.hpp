@@ -0,0 +1,133 @@
+#pragma once
+
+#include <cstddef>
+#include <cstring>
+#include <new>
+#include <type_traits>
+#include <utility>
+
+#ifdef EVENT_PROFILING
+#include <typeinfo>
+#endif
+
+template <class Signature, std::size_t Capacity = 4 * sizeof(void*)>
+class Delegate;
+
+/*
+    A move-only replacement for std::function which stores the callable inline in a fixed
+    size buffer. It never allocates, callables that do not fit fail to compile instead.
+*/
+template <class R, class ...Args, std::size_t Capacity>
+class Delegate<R(Args...), Capacity> {
+public:
+
+    Delegate() { }
+
+    Delegate(std::nullptr_t) { }
+
+    template <class F, class = typename std::enable_if<!std::is_same<typename std::decay<F>::type, Delegate>::value>::type>
+    Delegate(F&& f) {
+        typedef typename std::decay<F>::type Callable;
+
+        static_assert(sizeof(Callable) <= Capacity, "Callable is too big for this Delegate, capture less or raise the capacity");
+        static_assert(alignof(Callable) <= alignof(Storage), "Callable is over-aligned for Delegate storage");
+
+        new (&storage) Callable(std::forward<F>(f));
+        invoke = &invoke_callable<Callable>;
+        manage = std::is_trivially_copyable<Callable>::value ? nullptr : &manage_callable<Callable>;
+
+#ifdef EVENT_PROFILING
+        type_name = typeid(Callable).name();
+#endif
+    }
+
+    Delegate(Delegate&& move) noexcept {
+        move_from(move);
+    }
+
+    Delegate& operator=(Delegate&& move) noexcept {
+        if (this != &move) {
+            reset();
+            move_from(move);
+        }
+        return *this;
+    }
+
+    Delegate(const Delegate&) = delete;
+    Delegate& operator=(const Delegate&) = delete;
+
+    ~Delegate() {
+        reset();
+    }
+
+    R operator()(Args... args) const {
+        return invoke(const_cast<Storage*>(&storage), std::forward<Args>(args)...);
+    }
+
+    explicit operator bool() const {
+        return invoke != nullptr;
+    }
+
+    // Identifies the type of the stored callable, equal for every Delegate holding the same lambda.
+    const void* target_id() const {
+        return reinterpret_cast<const void*>(invoke);
+    }
+
+#ifdef EVENT_PROFILING
+    const char* target_name() const {
+        return type_name;
+    }
+#endif
+
+    void reset() {
+        if (manage) {
+            manage(&storage, nullptr);
+        }
+        invoke = nullptr;
+        manage = nullptr;
+    }
+
+private:
+    typedef typename std::aligned_storage<Capacity, alignof(std::max_align_t)>::type Storage;
+
+    // Move constructs into `dst` when it is set, otherwise destroys `src`.
+    typedef void (*Manager)(Storage* src, Storage* dst);
+    typedef R (*Invoker)(Storage* storage, Args&&... args);
+
+    template <class Callable>
+    static R invoke_callable(Storage* storage, Args&&... args) {
+        return (*reinterpret_cast<Callable*>(storage))(std::forward<Args>(args)...);
+    }
+
+    template <class Callable>
+    static void manage_callable(Storage* src, Storage* dst) {
+        Callable* c = reinterpret_cast<Callable*>(src);
+        if (dst) {
+            new (dst) Callable(std::move(*c));
+        }
+        c->~Callable();
+    }
+
+    void move_from(Delegate& move) {
+        if (move.manage) {
+            move.manage(&move.storage, &storage);
+        } else if (move.invoke) {
+            std::memcpy(&storage, &move.storage, sizeof(Storage));
+        }
+        invoke = move.invoke;
+        manage = move.manage;
+#ifdef EVENT_PROFILING
+        type_name = move.type_name;
+#endif
+        move.invoke = nullptr;
+        move.manage = nullptr;
+    }
+
+    Storage storage{}; // zeroed, moves copy the whole buffer for trivially copyable callables
+    Invoker invoke = nullptr;
+    Manager manage = nullptr;
+
+#ifdef EVENT_PROFILING
+    const char* type_name = nullptr;
+#endif
+};
@@ -0,0 +1,379 @@
+#pragma once
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include <nanovg.h>
+#include <glm/glm.hpp>
+
+#include "canvas.hpp"
+
+/*
+    Records drawing with the same calls as Canvas so it can be replayed into a real Canvas
+    any number of times. Commands are small PODs in one array, their arguments go into a flat
+    float array and text into a pooled character buffer, so recording allocates nothing once
+    the buffers have grown and a list can be recorded on any thread, no nanovg context needed.
+*/
+
+enum class DisplayOp : std::uint8_t {
+    push_state, pop_state,
+    font_name, font_id, font_size, text,
+    reset_transform, transform, translate, rotate, scale,
+    scissor, intersect_scissor, reset_scissor,
+    begin_path, move_to, line_to, bezier_to, quad_to, arc_to, close_path, path_winding,
+    arc, rect, rounded_rect, ellipse, circle,
+    fill_color, fill_paint, stroke_color, stroke_paint
+};
+
+// `a` and `b` are offsets into the list's arrays or plain integers, depending on `op`.
+struct DisplayCommand {
+    DisplayOp op;
+    std::uint32_t a, b;
+};
+
+struct DisplayText {
+    std::uint32_t offset, length; // in the string pool
+    std::uint32_t values;         // x, y, r, g, b, a
+    int align;
+};
+
+
+class DisplayList {
+public:
+
+    void clear() {
+        commands.clear();
+        values.clear();
+        paints.clear();
+        texts.clear();
+        strings.clear();
+    }
+
+    bool empty() const {
+        return commands.empty();
+    }
+
+    std::size_t size() const {
+        return commands.size();
+    }
+
+    // Memory in use by the recorded commands, not counting spare capacity.
+    std::size_t get_bytes() const {
+        return commands.size() * sizeof(DisplayCommand) + values.size() * sizeof(float) + paints.size() * sizeof(NVGpaint) +
+               texts.size() * sizeof(DisplayText) + strings.size();
+    }
+
+    const std::vector<DisplayCommand>& get_commands() const {
+        return commands;
+    }
+
+
+    // State operations
+
+    void push_state() {
+        add(DisplayOp::push_state);
+    }
+
+    void pop_state() {
+        add(DisplayOp::pop_state);
+    }
+
+
+    // Font operations
+
+    void set_font(Font font, float size) {
+        add(DisplayOp::font_id, (std::uint32_t)font, push(size));
+    }
+
+    void set_font(const std::string& name, float size) {
+        add(DisplayOp::font_name, intern(name.data(), name.size()), push(size));
+    }
+
+    void font_size(float size) {
+        add(DisplayOp::font_size, push(size));
+    }
+
+    void text(const glm::vec2& pos, const std::string& text, const Color& color, Align align) {
+        DisplayText t;
+        t.offset = intern(text.data(), text.size());
+        t.length = (std::uint32_t)text.size();
+        t.values = push(pos.x, pos.y, color.r, color.g, color.b, color.a);
+        t.align = static_cast<int>(align);
+
+        add(DisplayOp::text, (std::uint32_t)texts.size());
+        texts.push_back(t);
+    }
+
+
+    // Paints, nanovg builds these without looking at the context
+
+    Color linear_gradient(const glm::vec2& p_start, const glm::vec2& p_end, const Color& c_start, const Color& c_end) {
+        return nvgLinearGradient(nullptr, p_start.x, p_start.y, p_end.x, p_end.y, c_start.c, c_end.c);
+    }
+
+    Color box_gradient(const glm::vec2& p_start, const glm::vec2& size, const Color& c_start, const Color& c_end, float radius, float feather) {
+        return nvgBoxGradient(nullptr, p_start.x, p_start.y, size.x, size.y, radius, feather, c_start.c, c_end.c);
+    }
+
+    Color radial_gradient(const glm::vec2& p, float start, float end, const Color& c_start, const Color& c_end) {
+        return nvgRadialGradient(nullptr, p.x, p.y, start, end, c_start.c, c_end.c);
+    }
+
+    Color image_pattern(const glm::vec2& pos, const glm::vec2& size, int image, float alpha = 1.0f) {
+        return nvgImagePattern(nullptr, pos.x, pos.y, size.x, size.y, 0.0f, image, alpha);
+    }
+
+
+    // Scissor operations
+
+    void scissor(const glm::vec2& pos, const glm::vec2& size) {
+        add(DisplayOp::scissor, push(pos.x, pos.y, size.x, size.y));
+    }
+
+    void intersect_scissor(const glm::vec2& pos, const glm::vec2& size) {
+        add(DisplayOp::intersect_scissor, push(pos.x, pos.y, size.x, size.y));
+    }
+
+    void reset_scissor() {
+        add(DisplayOp::reset_scissor);
+    }
+
+
+    // Transform operations
+
+    void reset_transform() {
+        add(DisplayOp::reset_transform);
+    }
+
+    void transform(const float* m) {
+        add(DisplayOp::transform, push(m[0], m[1], m[2], m[3], m[4], m[5]));
+    }
+
+    void translate(const glm::vec2& p) {
+        add(DisplayOp::translate, push(p.x, p.y));
+    }
+
+    void rotate(float r) {
+        add(DisplayOp::rotate, push(r));
+    }
+
+    void scale(const glm::vec2& s) {
+        add(DisplayOp::scale, push(s.x, s.y));
+    }
+
+
+    // Path operations
+
+    void begin_path() {
+        add(DisplayOp::begin_path);
+    }
+
+    void move_to(const glm::vec2& pos) {
+        add(DisplayOp::move_to, push(pos.x, pos.y));
+    }
+
+    void line_to(const glm::vec2& pos) {
+        add(DisplayOp::line_to, push(pos.x, pos.y));
+    }
+
+    void bezier_to(const glm::vec2& c1, const glm::vec2& c2, const glm::vec2& pos) {
+        add(DisplayOp::bezier_to, push(c1.x, c1.y, c2.x, c2.y, pos.x, pos.y));
+    }
+
+    void quad_to(const glm::vec2& c, const glm::vec2& pos) {
+        add(DisplayOp::quad_to, push(c.x, c.y, pos.x, pos.y));
+    }
+
+    void arc_to(const glm::vec2& p1, const glm::vec2& p2, float r) {
+        add(DisplayOp::arc_to, push(p1.x, p1.y, p2.x, p2.y, r));
+    }
+
+    void close_path() {
+        add(DisplayOp::close_path);
+    }
+
+    void path_winding(int dir) {
+        add(DisplayOp::path_winding, 0, (std::uint32_t)dir);
+    }
+
+    void arc(const glm::vec2& pos, float r, float a0, float a1, int dir) {
+        add(DisplayOp::arc, push(pos.x, pos.y, r, a0, a1), (std::uint32_t)dir);
+    }
+
+    void rect(const glm::vec2& pos, const glm::vec2& size) {
+        add(DisplayOp::rect, push(pos.x, pos.y, size.x, size.y));
+    }
+
+    void rounded_rect(const glm::vec2& pos, const glm::vec2& size, float r) {
+        add(DisplayOp::rounded_rect, push(pos.x, pos.y, size.x, size.y, r));
+    }
+
+    void ellipse(const glm::vec2& pos, const glm::vec2& radius) {
+        add(DisplayOp::ellipse, push(pos.x, pos.y, radius.x, radius.y));
+    }
+
+    void circle(const glm::vec2& pos, float radius) {
+        add(DisplayOp::circle, push(pos.x, pos.y, radius));
+    }
+
+    void fill(const Color& color) {
+        if (color.solid) {
+            add(DisplayOp::fill_color, push(color.r, color.g, color.b, color.a));
+        } else {
+            add(DisplayOp::fill_paint, (std::uint32_t)paints.size());
+            paints.push_back(color.paint);
+        }
+    }
+
+    void stroke(const Color& color, float width) {
+        if (color.solid) {
+            add(DisplayOp::stroke_color, push(color.r, color.g, color.b, color.a, width));
+        } else {
+            add(DisplayOp::stroke_paint, (std::uint32_t)paints.size(), push(width));
+            paints.push_back(color.paint);
+        }
+    }
+
+
+    // Appends another list's commands, e.g. one recorded on another thread.
+    void append(const DisplayList& list) {
+        std::uint32_t value_base = (std::uint32_t)values.size();
+        std::uint32_t paint_base = (std::uint32_t)paints.size();
+        std::uint32_t text_base = (std::uint32_t)texts.size();
+        std::uint32_t string_base = (std::uint32_t)strings.size();
+
+        values.insert(values.end(), list.values.begin(), list.values.end());
+        paints.insert(paints.end(), list.paints.begin(), list.paints.end());
+        strings.insert(strings.end(), list.strings.begin(), list.strings.end());
+        for (DisplayText t : list.texts) {
+            t.offset += string_base;
+            t.values += value_base;
+            texts.push_back(t);
+        }
+
+        for (DisplayCommand c : list.commands) {
+            switch (c.op) {
+            case DisplayOp::text: c.a += text_base; break;
+            case DisplayOp::font_name: c.a += string_base; c.b += value_base; break;
+            case DisplayOp::font_id: c.b += value_base; break;
+            case DisplayOp::fill_paint: c.a += paint_base; break;
+            case DisplayOp::stroke_paint: c.a += paint_base; c.b += value_base; break;
+            default:
+                if (uses_values(c.op)) {
+                    c.a += value_base;
+                }
+                break;
+            }
+            commands.push_back(c);
+        }
+    }
+
+
+    /*
+        Draws the list into `canvas`, inside a push_state / pop_state pair so the list can't
+        leave state behind. `transform`, a nanovg 2x3 matrix, is applied on top of the canvas'
+        current transform first, e.g. to place a recorded widget.
+    */
+    void replay(Canvas& canvas, const float* transform = nullptr) const {
+        canvas.push_state();
+        if (transform) {
+            canvas.transform(transform);
+        }
+
+        std::string font;
+        for (auto& c : commands) {
+            const float* v = values.data() + c.a;
+            switch (c.op) {
+            case DisplayOp::push_state: canvas.push_state(); break;
+            case DisplayOp::pop_state: canvas.pop_state(); break;
+
+            case DisplayOp::font_name:
+                font.assign(strings.data() + c.a);
+                canvas.set_font(font, values[c.b]);
+                break;
+            case DisplayOp::font_id: canvas.set_font((Font)c.a, values[c.b]); break;
+            case DisplayOp::font_size: canvas.font_size(v[0]); break;
+            case DisplayOp::text: {
+                auto& t = texts[c.a];
+                const float* tv = values.data() + t.values;
+                const char* begin = strings.data() + t.offset;
+                canvas.text({ tv[0], tv[1] }, begin, begin + t.length, { tv[2], tv[3], tv[4], tv[5] }, static_cast<Align>(t.align));
+                break;
+            }
+
+            case DisplayOp::reset_transform: canvas.reset_transform(); break;
+            case DisplayOp::transform: canvas.transform(v); break;
+            case DisplayOp::translate: canvas.translate({ v[0], v[1] }); break;
+            case DisplayOp::rotate: canvas.rotate(v[0]); break;
+            case DisplayOp::scale: canvas.scale({ v[0], v[1] }); break;
+
+            case DisplayOp::scissor: canvas.scissor({ v[0], v[1] }, { v[2], v[3] }); break;
+            case DisplayOp::intersect_scissor: canvas.intersect_scissor({ v[0], v[1] }, { v[2], v[3] }); break;
+            case DisplayOp::reset_scissor: canvas.reset_scissor(); break;
+
+            case DisplayOp::begin_path: canvas.begin_path(); break;
+            case DisplayOp::move_to: canvas.move_to({ v[0], v[1] }); break;
+            case DisplayOp::line_to: canvas.line_to({ v[0], v[1] }); break;
+            case DisplayOp::bezier_to: canvas.bezier_to({ v[0], v[1] }, { v[2], v[3] }, { v[4], v[5] }); break;
+            case DisplayOp::quad_to: canvas.quad_to({ v[0], v[1] }, { v[2], v[3] }); break;
+            case DisplayOp::arc_to: canvas.arc_to({ v[0], v[1] }, { v[2], v[3] }, v[4]); break;
+            case DisplayOp::close_path: canvas.close_path(); break;
+            case DisplayOp::path_winding: canvas.path_winding((int)c.b); break;
+
+            case DisplayOp::arc: canvas.arc({ v[0], v[1] }, v[2], v[3], v[4], (int)c.b); break;
+            case DisplayOp::rect: canvas.rect({ v[0], v[1] }, { v[2], v[3] }); break;
+            case DisplayOp::rounded_rect: canvas.rounded_rect({ v[0], v[1] }, { v[2], v[3] }, v[4]); break;
+            case DisplayOp::ellipse: canvas.ellipse({ v[0], v[1] }, { v[2], v[3] }); break;
+            case DisplayOp::circle: canvas.circle({ v[0], v[1] }, v[2]); break;
+
+            case DisplayOp::fill_color: canvas.fill({ v[0], v[1], v[2], v[3] }); break;
+            case DisplayOp::fill_paint: canvas.fill(paints[c.a]); break;
+            case DisplayOp::stroke_color: canvas.stroke({ v[0], v[1], v[2], v[3] }, v[4]); break;
+            case DisplayOp::stroke_paint: canvas.stroke(paints[c.a], values[c.b]); break;
+            }
+        }
+
+        canvas.pop_state();
+    }
+
+private:
+
+    // Ops whose `a` is an offset into `values`.
+    static bool uses_values(DisplayOp op) {
+        switch (op) {
+        case DisplayOp::push_state: case DisplayOp::pop_state:
+        case DisplayOp::reset_transform: case DisplayOp::reset_scissor:
+        case DisplayOp::begin_path: case DisplayOp::close_path: case DisplayOp::path_winding:
+            return false;
+        default:
+            return true;
+        }
+    }
+
+    void add(DisplayOp op, std::uint32_t a = 0, std::uint32_t b = 0) {
+        commands.push_back({ op, a, b });
+    }
+
+    // Appends the arguments to the value array and returns the offset of the first.
+    template <class... Floats>
+    std::uint32_t push(Floats... v) {
+        std::uint32_t offset = (std::uint32_t)values.size();
+        float args[] = { (float)v... };
+        values.insert(values.end(), args, args + sizeof...(v));
+        return offset;
+    }
+
+    // Copies `length` characters into the pool, null terminated so names can be passed on as they are.
+    std::uint32_t intern(const char* s, std::size_t length) {
+        std::uint32_t offset = (std::uint32_t)strings.size();
+        strings.insert(strings.end(), s, s + length);
+        strings.push_back('\0');
+        return offset;
+    }
+
+    std::vector<DisplayCommand> commands;
+    std::vector<float> values;
+    std::vector<NVGpaint> paints;
+    std::vector<DisplayText> texts;
+    std::vector<char> strings;
+};
@@ -0,0 +1,64 @@
+#pragma once
+#include <algorithm>
+#include <cmath>
+
+/*
+    Picks the scale the scene is rendered at from measured GPU frame times. Cost is taken to
+    grow with the pixel count, so the scale moves by the square root of how far off the
+    frame was, and only in whole steps so the offscreen target is not reallocated every frame.
+*/
+class DynamicResolution {
+public:
+
+    void set_range(float min, float max = 1.0f) {
+        min_scale = min;
+        max_scale = std::max(min, max);
+        scale = std::min(std::max(scale, min_scale), max_scale);
+    }
+
+    float get_scale() const {
+        return scale;
+    }
+
+    // Feeds the GPU time of one finished frame, returns true when the scale changed.
+    bool update(double frame_ms, double budget_ms) {
+        smoothed_ms = smoothed_ms < 0.0 ? frame_ms : smoothed_ms * 0.9 + frame_ms * 0.1;
+
+        // Timer results lag a few frames behind, let them catch up with the last change first.
+        if (++settled < settle_frames || smoothed_ms <= 0.0) {
+            return false;
+        }
+
+        // Aim under the budget so a small spike does not miss the frame.
+        double target_ms = budget_ms * headroom;
+        float wanted = scale * (float)std::sqrt(target_ms / smoothed_ms);
+        wanted = std::min(std::max(std::floor(wanted / step + 0.001f) * step, min_scale), max_scale);
+
+        if (std::abs(wanted - scale) < step * 0.5f) {
+            return false;
+        }
+
+        scale = wanted;
+        settled = 0;
+        smoothed_ms = -1.0;
+        return true;
+    }
+
+    void reset() {
+        scale = max_scale;
+        settled = 0;
+        smoothed_ms = -1.0;
+    }
+
+private:
+
+    static constexpr float step = 0.05f;
+    static constexpr double headroom = 0.85;
+    static const int settle_frames = 8;
+
+    float min_scale = 0.5f, max_scale = 1.0f;
+    float scale = 1.0f;
+
+    double smoothed_ms = -1.0;
+    int settled = 0;
+};
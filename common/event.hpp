@@ -1,61 +1,513 @@
 #pragma once
 
-#include <functional>
-#include <unordered_map>
-#include <unordered_set>
+#include <atomic>
+#include <cstdint>
+#include <tuple>
+#include <utility>
 #include <vector>
 
+#include "delegate.hpp"
+#include "event_queue.hpp"
+
+#ifdef EVENT_PROFILING
+#include "event_profiler.hpp"
+#endif
+
+// Size of the inline buffer each Event handler gets, captures bigger than this fail to compile.
+#ifndef EVENT_DELEGATE_CAPACITY
+#define EVENT_DELEGATE_CAPACITY (4 * sizeof(void*))
+#endif
+
+class EventBase;
 class EventContext;
 
+// How samples handed to Event::coalesce are combined until Event::dispatch_coalesced runs.
+enum class Coalesce {
+    none, // no buffering, every sample is dispatched straight away
+    latest, // only the most recent sample is dispatched
+    accumulate, // samples are summed element by element and dispatched once
+    keep_all // every sample is kept and dispatched in order
+};
+
+namespace detail {
+
+    template <class T>
+    auto coalesce_add(T& total, const T& sample, int) -> decltype(total = total + sample, void()) {
+        total = total + sample;
+    }
+
+    // Types without an operator+ fall back to the latest sample.
+    template <class T>
+    void coalesce_add(T& total, const T& sample, long) {
+        total = sample;
+    }
+
+}
+
+/*
+    Intrusive link between an Event slot and the EventContext that registered it. The node is
+    stored inline in the event's slot and threaded onto a singly linked list rooted in the
+    context, with a back pointer to whatever points at it so it can unlink itself in O(1).
+    Moving the node (when the slot vector grows or compacts) patches its neighbours.
+*/
+class ConnectionNode {
+public:
+
+    ConnectionNode(EventBase* event = nullptr) : event(event) { }
+
+    ConnectionNode(ConnectionNode&& move) noexcept {
+        take(move);
+    }
+
+    ConnectionNode& operator=(ConnectionNode&& move) noexcept {
+        if (this != &move) {
+            unlink();
+            take(move);
+        }
+        return *this;
+    }
+
+    ConnectionNode(const ConnectionNode&) = delete;
+    void operator=(const ConnectionNode&) = delete;
+
+    ~ConnectionNode() {
+        unlink();
+    }
+
+    void link(ConnectionNode*& head) {
+        next = head;
+        if (next) {
+            next->prev = &next;
+        }
+        prev = &head;
+        head = this;
+    }
+
+    void unlink() {
+        if (prev) {
+            *prev = next;
+            if (next) {
+                next->prev = prev;
+            }
+        }
+        next = nullptr;
+        prev = nullptr;
+    }
+
+    ConnectionNode* next = nullptr;
+    ConnectionNode** prev = nullptr; // the pointer that points at us, either a list head or the previous next
+    EventBase* event = nullptr; // nullptr marks a tombstone
+
+private:
+
+    void take(ConnectionNode& move) {
+        next = move.next;
+        prev = move.prev;
+        event = move.event;
+
+        if (prev) {
+            *prev = this;
+        }
+        if (next) {
+            next->prev = &next;
+        }
+
+        move.next = nullptr;
+        move.prev = nullptr;
+        move.event = nullptr;
+    }
+};
+
+
 class EventBase {
 public:
-    virtual void unregister_context(EventContext* context) = 0;
-    virtual void swap_contexts(EventContext* old, EventContext* ctx) = 0;
+    static const std::uint32_t no_key = ~0u;
+
+    // Tombstones the handler behind a Connection, handles that no longer match are ignored.
+    virtual void disconnect(std::uint32_t key, std::uint32_t generation) = 0;
+
+    bool is_connected(std::uint32_t key, std::uint32_t generation) const {
+        return key < keys.size() && keys[key].generation == generation;
+    }
+
+protected:
+    ~EventBase() { }
+
+    // Keys give Connection handles a stable index into the slot vector, which compaction reorders.
+    struct Key {
+        std::uint32_t slot; // index of the slot, or the next free key while unused
+        std::uint32_t generation;
+    };
+
+    std::uint32_t allocate_key(std::uint32_t slot) {
+        std::uint32_t key = free_keys;
+        if (key == no_key) {
+            key = (std::uint32_t)keys.size();
+            keys.push_back({ slot, 1 });
+        } else {
+            free_keys = keys[key].slot;
+            keys[key].slot = slot;
+        }
+        return key;
+    }
+
+    void free_key(std::uint32_t key) {
+        keys[key].generation++;
+        keys[key].slot = free_keys;
+        free_keys = key;
+    }
+
+    std::vector<Key> keys;
+    std::uint32_t free_keys = no_key;
+
+    // Our entry in the EventRegistry, only taken once the first Connection is handed out.
+    std::uint32_t handle = no_key, handle_generation = 0;
+
+    std::size_t tombstones = 0;
+    int dispatching = 0;
+
+    friend class EventContext;
+};
+
+
+/*
+    Maps the event half of a Connection onto a live event. Entries are recycled with a new
+    generation when an event dies, so handles to it stop resolving instead of dangling.
+*/
+class EventRegistry {
+public:
+
+    static EventRegistry& get() {
+        static EventRegistry registry;
+        return registry;
+    }
+
+    void add(EventBase* event, std::uint32_t& index, std::uint32_t& generation) {
+        index = free_entries;
+        if (index == EventBase::no_key) {
+            index = (std::uint32_t)entries.size();
+            entries.push_back({ event, 1, EventBase::no_key });
+        } else {
+            free_entries = entries[index].next_free;
+            entries[index].event = event;
+        }
+        generation = entries[index].generation;
+    }
+
+    void remove(std::uint32_t index) {
+        entries[index].event = nullptr;
+        entries[index].generation++;
+        entries[index].next_free = free_entries;
+        free_entries = index;
+    }
+
+    EventBase* find(std::uint32_t index, std::uint32_t generation) const {
+        if (index < entries.size() && entries[index].generation == generation) {
+            return entries[index].event;
+        }
+        return nullptr;
+    }
+
+private:
+    struct Entry {
+        EventBase* event;
+        std::uint32_t generation;
+        std::uint32_t next_free;
+    };
+
+    std::vector<Entry> entries;
+    std::uint32_t free_entries = EventBase::no_key;
+};
+
+
+/*
+    Handle to a handler added with Event::connect, an alternative to inheriting EventContext.
+    It is a plain value that can be copied and stored anywhere. Once the handler or the event
+    is gone the generations stop matching and the handle simply does nothing.
+*/
+struct Connection {
+    std::uint32_t event = 0, event_generation = 0;
+    std::uint32_t slot = 0, generation = 0;
+
+    bool connected() const {
+        EventBase* e = EventRegistry::get().find(event, event_generation);
+        return e && e->is_connected(slot, generation);
+    }
+
+    void disconnect() {
+        if (EventBase* e = EventRegistry::get().find(event, event_generation)) {
+            e->disconnect(slot, generation);
+        }
+        *this = Connection();
+    }
 };
 
+/*
+    Delegates live in a contiguous slot vector so that dispatch is a linear scan. Unregistering
+    only leaves a tombstone behind, the vector is compacted later once enough of them pile up.
+*/
 template <class ...Args>
 class Event : EventBase {
 public:
-    typedef std::function<void(Args...)> Delegate;
+    typedef ::Delegate<void(Args...), EVENT_DELEGATE_CAPACITY> Delegate;
+
+    Event() : Event(nullptr) { }
+
+    // The name is only kept when EVENT_PROFILING is defined, it labels the event in the profiler output.
+    explicit Event(const char* name) {
+#ifdef EVENT_PROFILING
+        profile.name = name ? name : "unnamed";
+        EventProfiler::get().add(&profile);
+#else
+        (void)name;
+#endif
+    }
+
+    Event(const Event&) = delete;
+    void operator=(const Event&) = delete;
 
     ~Event() {
-        for (auto& d : delegates) {
-            d.first->clear_event(this);
+        if (posted.load(std::memory_order_acquire)) {
+            EventQueue::main().discard(this);
+        }
+        if (handle != no_key) {
+            EventRegistry::get().remove(handle);
         }
+#ifdef EVENT_PROFILING
+        EventProfiler::get().remove(&profile);
+#endif
     }
 
     void operator()(const Args&... args) {
-        for (auto& d : delegates) {
-            if (!remove.count(d.first)) {
-                d.second(args...);
+#ifdef EVENT_PROFILING
+        profile.dispatches++;
+        ProfileTimer dispatch_timer(profile.latency);
+#endif
+        ++dispatching;
+        for (std::size_t i = 0; i < slots.size(); ++i) {
+            if (slots[i].node.event) {
+#ifdef EVENT_PROFILING
+                ProfileTimer timer(slots[i].stats->latency);
+#endif
+                slots[i].delegate(args...);
+            }
+        }
+        --dispatching;
+
+        if (!dispatching) {
+            flush();
+        }
+#ifdef EVENT_PROFILING
+        profile.handlers = size();
+#endif
+    }
+
+    void set_coalescing(Coalesce policy) {
+        coalescing = policy;
+    }
+
+    // Buffer a sample according to the coalescing policy, it is dispatched by dispatch_coalesced.
+    void coalesce(const Args&... args) {
+        ++sample_count;
+
+        switch (coalescing) {
+        case Coalesce::none:
+            (*this)(args...);
+            break;
+
+        case Coalesce::latest:
+            if (samples.empty()) {
+                samples.emplace_back(args...);
+            } else {
+                samples.back() = std::tie(args...);
+            }
+            break;
+
+        case Coalesce::accumulate:
+            if (samples.empty()) {
+                samples.emplace_back(args...);
+            } else {
+                add(samples.back(), std::tie(args...), std::make_index_sequence<sizeof...(Args)>());
             }
+            break;
+
+        case Coalesce::keep_all:
+            samples.emplace_back(args...);
+            break;
+        }
+    }
+
+    // Delivers the buffered samples early, e.g. so motion lands before a click. They still count towards the next dispatch_coalesced.
+    void flush_coalesced() {
+        std::swap(samples, delivering);
+        for (auto& s : delivering) {
+            call(s);
+        }
+        delivering.clear();
+    }
+
+    // Delivers the buffered samples and ends the frame's sample count.
+    void dispatch_coalesced() {
+        flush_coalesced();
+
+        last_sample_count = sample_count;
+        sample_count = 0;
+    }
+
+    // Number of raw samples that went into the last dispatch_coalesced and the flushes since the one before it.
+    std::size_t get_sample_count() const {
+        return last_sample_count;
+    }
+
+    // Subscribe without an EventContext, the returned handle disconnects in O(1) and is safe to keep after the event dies.
+    Connection connect(Delegate delegate) {
+        if (handle == no_key) {
+            EventRegistry::get().add(this, handle, handle_generation);
+        }
+
+        std::uint32_t index = push_slot(std::move(delegate));
+        std::uint32_t key = allocate_key(index);
+        get_slot(index).key = key;
+
+        Connection connection;
+        connection.event = handle;
+        connection.event_generation = handle_generation;
+        connection.slot = key;
+        connection.generation = keys[key].generation;
+
+        if (!dispatching) {
+            flush();
+        }
+        return connection;
+    }
+
+    void disconnect(std::uint32_t key, std::uint32_t generation) override {
+        if (!is_connected(key, generation)) {
+            return;
+        }
+
+        Slot& slot = get_slot(keys[key].slot);
+        slot.node.event = nullptr;
+        slot.key = no_key;
+        ++tombstones;
+        free_key(key);
+
+        if (!dispatching) {
+            flush();
         }
+    }
+
+    // Queue a dispatch from any thread, it is delivered on the main thread when EventQueue::main() is drained.
+    void post(const Args&... args) {
+        posted.store(true, std::memory_order_release);
+        EventQueue::main().push(new Posted(this, args...));
+    }
 
-        clear_contexts();
+    std::size_t size() const {
+        return slots.size() + pending.size() - tombstones;
     }
 
 private:
-    std::unordered_map<EventContext*, Delegate> delegates;
-    std::unordered_set<EventContext*> remove;
+    struct Posted : EventQueue::Node {
+        Posted(Event* event, const Args&... args) : event(event), args(args...) {
+            target = event;
+        }
+
+        void deliver() override {
+            event->call(args);
+        }
+
+        Event* event;
+        std::tuple<Args...> args;
+    };
+
+    struct Slot {
+        ConnectionNode node;
+        Delegate delegate;
+        std::uint32_t key; // no_key unless the slot belongs to a Connection
+#ifdef EVENT_PROFILING
+        HandlerStats* stats = nullptr; // set by push_slot
+#endif
+    };
+
+    // Slots registered while dispatching wait here so the vector never reallocates under a running delegate.
+    std::vector<Slot> slots, pending;
+    std::atomic<bool> posted { false };
+
+#ifdef EVENT_PROFILING
+    EventStats profile;
+#endif
+
+    Coalesce coalescing = Coalesce::none;
+    std::vector<std::tuple<Args...>> samples, delivering;
+    std::size_t sample_count = 0, last_sample_count = 0;
+
+    void call(const std::tuple<Args...>& args) {
+        call(args, std::make_index_sequence<sizeof...(Args)>());
+    }
 
-    void register_context(EventContext* context, Delegate delegate) {
-        delegates[context] = delegate;
+    template <std::size_t ...I>
+    void call(const std::tuple<Args...>& args, std::index_sequence<I...>) {
+        (*this)(std::get<I>(args)...);
     }
 
-    void unregister_context(EventContext* context) override {
-        remove.insert(context);
+    template <std::size_t ...I>
+    static void add(std::tuple<Args...>& total, const std::tuple<const Args&...>& sample, std::index_sequence<I...>) {
+        int expand[] = { 0, (detail::coalesce_add(std::get<I>(total), std::get<I>(sample), 0), 0)... };
+        (void)expand;
     }
 
-    void swap_contexts(EventContext* old, EventContext* ctx) override {
-        delegates[ctx] = delegates[old];
-        delegates.erase(old);
+    std::uint32_t push_slot(Delegate delegate) {
+        std::uint32_t index = (std::uint32_t)(slots.size() + pending.size());
+
+        auto& list = dispatching ? pending : slots;
+        list.push_back({ ConnectionNode(this), std::move(delegate), no_key });
+#ifdef EVENT_PROFILING
+        list.back().stats = profile.get_handler(list.back().delegate.target_id(), list.back().delegate.target_name());
+#endif
+        return index;
+    }
+
+    Slot& get_slot(std::uint32_t index) {
+        return index < slots.size() ? slots[index] : pending[index - slots.size()];
+    }
+
+    void connect(ConnectionNode*& head, Delegate delegate) {
+        get_slot(push_slot(std::move(delegate))).node.link(head);
+
+        if (!dispatching) {
+            flush();
+        }
+    }
+
+    void flush() {
+        for (auto& s : pending) {
+            slots.push_back(std::move(s));
+        }
+        pending.clear();
+
+        // Only compact once at least half of the vector is dead so the cost is amortized over the removals.
+        if (tombstones > 0 && tombstones * 2 >= slots.size()) {
+            compact();
+        }
     }
 
-    void clear_contexts() {
-        for (auto c : remove) {
-            delegates.erase(c);
+    void compact() {
+        std::size_t live = 0;
+        for (std::size_t i = 0; i < slots.size(); ++i) {
+            if (!slots[i].node.event) {
+                continue;
+            }
+            if (live != i) {
+                slots[live] = std::move(slots[i]);
+                if (slots[live].key != no_key) {
+                    keys[slots[live].key].slot = (std::uint32_t)live;
+                }
+            }
+            ++live;
         }
-        remove.clear();
+        slots.erase(slots.begin() + live, slots.end());
+        tombstones = 0;
     }
 
     friend class EventContext;
@@ -64,6 +516,7 @@ private:
 
 /*
     Inherit from this class if you want to be able to register to events from other objects.
+    Registering the same event more than once adds another handler, unregister_event drops all of them.
 */
 class EventContext {
 public:
@@ -75,10 +528,12 @@ public:
     }
 
     void operator=(EventContext&& move) {
-        std::swap(events, move.events);
-
-        for (auto event : events) {
-            event->swap_contexts(&move, this);
+        std::swap(connections, move.connections);
+        if (connections) {
+            connections->prev = &connections;
+        }
+        if (move.connections) {
+            move.connections->prev = &move.connections;
         }
     }
 
@@ -86,30 +541,36 @@ public:
     void operator=(const EventContext&) = delete;
 
     ~EventContext() {
-        for (auto event : events) {
-            event->unregister_context(this);
+        while (connections) {
+            disconnect(connections);
         }
     }
 
     template <class ...Args>
     void register_event(Event<Args...>& event, typename Event<Args...>::Delegate delegate) {
-        event.register_context(this, delegate);
-        events.insert(&event);
+        event.connect(connections, std::move(delegate));
     }
 
     template <class ...Args>
     void unregister_event(Event<Args...>& event) {
-        event.unregister_context(this);
-        events.erase(&event);
+        EventBase* base = &event;
+        ConnectionNode* node = connections;
+        while (node) {
+            ConnectionNode* next = node->next;
+            if (node->event == base) {
+                disconnect(node);
+            }
+            node = next;
+        }
     }
 
 private:
 
-    void clear_event(EventBase* event) {
-        events.erase(event);
+    static void disconnect(ConnectionNode* node) {
+        node->event->tombstones++;
+        node->event = nullptr;
+        node->unlink();
     }
 
-    std::unordered_set<EventBase*> events;
-
-    template <class ...Args> friend class Event;
-};
\ No newline at end of file
+    ConnectionNode* connections = nullptr;
+};
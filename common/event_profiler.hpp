@@ -0,0 +1,162 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <map>
+#include <string>
+#include <vector>
+
+#include <SDL.h>
+
+#include "json.hpp"
+
+/*
+    Dispatch statistics for Events, only compiled in when EVENT_PROFILING is defined.
+    Each Event registers its EventStats with the EventProfiler, and every handler call is timed
+    with SDL_GetPerformanceCounter into a per handler latency histogram.
+*/
+
+struct LatencyHistogram {
+    // Bucket i counts the samples that took [2^i, 2^(i+1)) nanoseconds.
+    std::array<std::uint64_t, 32> buckets {};
+    std::uint64_t count = 0, total_ns = 0, max_ns = 0;
+
+    void record(std::uint64_t ns) {
+        int bucket = 0;
+        while (bucket < (int)buckets.size() - 1 && (ns >> (bucket + 1))) {
+            ++bucket;
+        }
+        buckets[bucket]++;
+
+        count++;
+        total_ns += ns;
+        max_ns = std::max(max_ns, ns);
+    }
+};
+
+struct HandlerStats {
+    std::string name; // type of the handler's callable, as reported by the compiler
+    LatencyHistogram latency;
+};
+
+struct EventStats {
+    std::string name;
+    std::uint64_t dispatches = 0;
+    std::size_t handlers = 0; // live handlers as of the last dispatch
+    LatencyHistogram latency; // whole dispatches
+
+    // Keyed by the handler's Delegate::target_id so handlers of the same lambda share their stats.
+    std::map<const void*, HandlerStats> handler_stats;
+
+    HandlerStats* get_handler(const void* id, const char* type) {
+        auto& h = handler_stats[id];
+        if (h.name.empty() && type) {
+            h.name = type;
+        }
+        return &h;
+    }
+};
+
+
+static void to_json(json& j, const LatencyHistogram& h) {
+    j = {
+        { "count", h.count },
+        { "total_ns", h.total_ns },
+        { "mean_ns", h.count ? h.total_ns / h.count : 0 },
+        { "max_ns", h.max_ns }
+    };
+
+    // Only emit the populated buckets, keyed by their lower bound.
+    json buckets = json::object();
+    for (std::size_t i = 0; i < h.buckets.size(); ++i) {
+        if (h.buckets[i]) {
+            buckets[std::to_string(1ull << i)] = h.buckets[i];
+        }
+    }
+    j["buckets_ns"] = buckets;
+}
+
+static void to_json(json& j, const EventStats& s) {
+    json handlers = json::array();
+    std::uint64_t handler_calls = 0;
+    for (auto& h : s.handler_stats) {
+        handlers.push_back({ { "handler", h.second.name }, { "latency", h.second.latency } });
+        handler_calls += h.second.latency.count;
+    }
+
+    j = {
+        { "name", s.name },
+        { "dispatches", s.dispatches },
+        { "handlers", s.handlers },
+        { "handler_calls", handler_calls },
+        { "latency", s.latency },
+        { "handler_latency", handlers }
+    };
+}
+
+
+class EventProfiler {
+public:
+
+    static EventProfiler& get() {
+        static EventProfiler profiler;
+        return profiler;
+    }
+
+    // Copies the current statistics of every live event.
+    std::vector<EventStats> snapshot() const {
+        std::vector<EventStats> result;
+        for (auto s : events) {
+            result.push_back(*s);
+        }
+        return result;
+    }
+
+    // Clears the counters but keeps the handler entries, events hold pointers into them.
+    void reset() {
+        for (auto s : events) {
+            s->dispatches = 0;
+            s->latency = LatencyHistogram();
+            for (auto& h : s->handler_stats) {
+                h.second.latency = LatencyHistogram();
+            }
+        }
+    }
+
+    std::uint64_t to_ns(std::uint64_t ticks) const {
+        return ticks * 1000000000ull / frequency;
+    }
+
+private:
+
+    EventProfiler() : frequency(SDL_GetPerformanceFrequency()) { }
+
+    void add(EventStats* stats) {
+        events.push_back(stats);
+    }
+
+    void remove(EventStats* stats) {
+        events.erase(std::remove(events.begin(), events.end(), stats), events.end());
+    }
+
+    std::vector<EventStats*> events;
+    std::uint64_t frequency;
+
+    template <class ...Args> friend class Event;
+};
+
+
+// Times one handler call (or a whole dispatch) into a histogram.
+class ProfileTimer {
+public:
+    ProfileTimer(LatencyHistogram& histogram) : histogram(histogram), start(SDL_GetPerformanceCounter()) { }
+
+    ~ProfileTimer() {
+        histogram.record(EventProfiler::get().to_ns(SDL_GetPerformanceCounter() - start));
+    }
+
+private:
+    LatencyHistogram& histogram;
+    std::uint64_t start;
+};
@@ -0,0 +1,140 @@
+#pragma once
+
+#include <atomic>
+#include <vector>
+
+/*
+    Lock-free multi-producer single-consumer queue of pending event deliveries, used by
+    Event::post. Any thread may push, only the main thread pops (Vyukov's intrusive queue).
+*/
+class EventQueue {
+public:
+
+    struct Node {
+        virtual ~Node() { }
+        virtual void deliver() { }
+
+        std::atomic<Node*> next { nullptr };
+        const void* target = nullptr;
+    };
+
+    EventQueue() : head(&stub), tail(&stub) { }
+
+    EventQueue(const EventQueue&) = delete;
+    void operator=(const EventQueue&) = delete;
+
+    ~EventQueue() {
+        collect();
+        for (auto node : batch) {
+            delete node;
+        }
+    }
+
+    // Safe to call from any thread, never blocks.
+    void push(Node* node) {
+        link(node);
+
+        // Only the first push after a drain needs to wake the consumer up.
+        auto callback = wake.load(std::memory_order_acquire);
+        if (callback && !wake_pending.exchange(true, std::memory_order_acq_rel)) {
+            callback();
+        }
+    }
+
+    // Called from the pushing thread when the queue gets work, so a consumer blocked elsewhere can wake up.
+    void set_wake(void (*callback)()) {
+        wake.store(callback, std::memory_order_release);
+    }
+
+    // Delivers everything posted before the call on the calling (main) thread, in order.
+    std::size_t drain() {
+        wake_pending.store(false, std::memory_order_release);
+        collect();
+
+        std::size_t delivered = 0;
+        for (std::size_t i = 0; i < batch.size(); ++i) {
+            if (batch[i]) {
+                batch[i]->deliver();
+                delete batch[i];
+                ++delivered;
+            }
+        }
+        batch.clear();
+        return delivered;
+    }
+
+    // Drops anything still queued for `target`. Main thread only.
+    void discard(const void* target) {
+        collect();
+
+        for (auto& node : batch) {
+            if (node && node->target == target) {
+                delete node;
+                node = nullptr;
+            }
+        }
+    }
+
+    // The queue drained by Window::process_events.
+    static EventQueue& main() {
+        static EventQueue queue;
+        return queue;
+    }
+
+private:
+
+    void link(Node* node) {
+        node->next.store(nullptr, std::memory_order_relaxed);
+        Node* prev = head.exchange(node, std::memory_order_acq_rel);
+        prev->next.store(node, std::memory_order_release);
+    }
+
+    // Moves everything currently in the queue onto the consumer side batch.
+    void collect() {
+        while (Node* node = pop()) {
+            batch.push_back(node);
+        }
+    }
+
+    Node* pop() {
+        Node* t = tail;
+        Node* next = t->next.load(std::memory_order_acquire);
+
+        if (t == &stub) {
+            if (!next) {
+                return nullptr;
+            }
+            tail = next;
+            t = next;
+            next = next->next.load(std::memory_order_acquire);
+        }
+
+        if (next) {
+            tail = next;
+            return t;
+        }
+
+        // A producer is half way through a push, pick it up next time.
+        if (t != head.load(std::memory_order_acquire)) {
+            return nullptr;
+        }
+
+        link(&stub);
+
+        next = t->next.load(std::memory_order_acquire);
+        if (next) {
+            tail = next;
+            return t;
+        }
+        return nullptr;
+    }
+
+    std::atomic<Node*> head;
+    Node* tail;
+    Node stub;
+
+    std::vector<Node*> batch;
+
+    std::atomic<void (*)()> wake { nullptr };
+    std::atomic<bool> wake_pending { false };
+};
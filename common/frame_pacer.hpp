@@ -0,0 +1,165 @@
+#pragma once
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+
+#include <SDL.h>
+
+enum class Pacing {
+    unlimited,      // swap as soon as the frame is done
+    vsync,          // wait for every vertical blank
+    adaptive_vsync, // vsync, but tear instead of halving the rate when a frame is late
+    capped          // no vsync, sleep to a fixed frame rate
+};
+
+/*
+    Controls how fast Window presents frames and tracks the time budget of the current frame.
+    The swap interval is applied through SDL, capped mode sleeps with SDL_Delay until shortly
+    before the deadline and then spins on the performance counter to hit it precisely.
+*/
+class FramePacer {
+public:
+
+    FramePacer() : frequency(SDL_GetPerformanceFrequency()) { }
+
+    // Needs the window's GL context to be current. Falls back to the closest mode the driver supports.
+    void set_mode(SDL_Window* window, Pacing requested, double fps = 0.0) {
+        mode = requested;
+
+        if (mode == Pacing::adaptive_vsync && SDL_GL_SetSwapInterval(-1) != 0) {
+            printf("Adaptive vsync is not supported, using vsync\n");
+            mode = Pacing::vsync;
+        }
+
+        if (mode == Pacing::vsync && SDL_GL_SetSwapInterval(1) != 0) {
+            printf("Vsync is not supported, capping the frame rate instead\n");
+            mode = Pacing::capped;
+        }
+
+        if (mode == Pacing::unlimited || mode == Pacing::capped) {
+            SDL_GL_SetSwapInterval(0);
+        }
+
+        set_period(window, fps);
+    }
+
+    /*
+        Like set_mode but leaves the swap interval alone, for a window presenting with a GL
+        context another window uses too. Such a window sets get_swap_interval itself right
+        before it swaps, and there is no fallback if the driver turns the interval down.
+    */
+    void choose_mode(SDL_Window* window, Pacing requested, double fps = 0.0) {
+        mode = requested;
+        set_period(window, fps);
+    }
+
+    Pacing get_mode() const {
+        return mode;
+    }
+
+    // The SDL swap interval of the current mode.
+    int get_swap_interval() const {
+        switch (mode) {
+        case Pacing::vsync: return 1;
+        case Pacing::adaptive_vsync: return -1;
+        default: return 0;
+        }
+    }
+
+
+    void begin_frame() {
+        frame_start = SDL_GetPerformanceCounter();
+    }
+
+    // Called after the buffer swap, in capped mode this is where the frame waits out its period.
+    void end_frame() {
+        if (mode == Pacing::capped) {
+            wait();
+        }
+
+        std::uint64_t now = SDL_GetPerformanceCounter();
+        last_frame = now - (last_present ? last_present : frame_start);
+        last_present = now;
+    }
+
+
+    // Time one frame is allowed to take.
+    double get_budget_ms() const {
+        return to_ms(period);
+    }
+
+    // Time spent since begin_frame.
+    double get_elapsed_ms() const {
+        return to_ms(SDL_GetPerformanceCounter() - frame_start);
+    }
+
+    // What is left of the budget this frame, negative once the frame is late.
+    double get_remaining_ms() const {
+        return get_budget_ms() - get_elapsed_ms();
+    }
+
+    bool over_budget() const {
+        return get_remaining_ms() < 0.0;
+    }
+
+    // Present to present time of the previous frame, including any waiting.
+    double get_frame_ms() const {
+        return to_ms(last_frame);
+    }
+
+private:
+
+    // SDL_Delay can oversleep by a scheduler tick, leave this much time to spin off.
+    static const std::uint32_t spin_ms = 2;
+
+    // Vsync and unlimited modes still get a budget, a frame should fit in one refresh.
+    void set_period(SDL_Window* window, double fps) {
+        if (mode != Pacing::capped || fps <= 0.0) {
+            fps = get_refresh_rate(window);
+        }
+        period = (std::uint64_t)(frequency / fps);
+        deadline = 0;
+    }
+
+    void wait() {
+        std::uint64_t now = SDL_GetPerformanceCounter();
+
+        // Step the deadline by whole periods so the rate does not drift, but start over after a stall.
+        deadline = deadline ? deadline + period : now + period;
+        if (deadline + period < now) {
+            deadline = now;
+            return;
+        }
+
+        if (deadline > now) {
+            std::uint64_t ms = (deadline - now) * 1000 / frequency;
+            if (ms > spin_ms) {
+                SDL_Delay((Uint32)(ms - spin_ms));
+            }
+        }
+
+        while (SDL_GetPerformanceCounter() < deadline) { }
+    }
+
+    static double get_refresh_rate(SDL_Window* window) {
+        SDL_DisplayMode display;
+        if (window && SDL_GetWindowDisplayMode(window, &display) == 0 && display.refresh_rate > 0) {
+            return display.refresh_rate;
+        }
+        return 60.0;
+    }
+
+    double to_ms(std::uint64_t ticks) const {
+        return ticks * 1000.0 / frequency;
+    }
+
+    Pacing mode = Pacing::unlimited;
+
+    std::uint64_t frequency;
+    std::uint64_t period = 0;
+    std::uint64_t deadline = 0;
+
+    std::uint64_t frame_start = 0;
+    std::uint64_t last_present = 0;
+    std::uint64_t last_frame = 0;
+};
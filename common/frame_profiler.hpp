@@ -0,0 +1,343 @@
+#pragma once
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <fstream>
+#include <string>
+#include <vector>
+
+#include <SDL.h>
+#include <GL/glew.h>
+
+#include "canvas.hpp"
+#include "json.hpp"
+#include "startup_trace.hpp"
+
+/*
+    Records where each frame's time goes. CPU zones are timed with SDL_GetPerformanceCounter
+    through ProfileZone scopes, the GPU side with GL_TIME_ELAPSED queries which are read back
+    a few frames later so the CPU never waits on them. The last N frames are kept in a ring.
+*/
+
+struct ZoneSample {
+    const char* name; // must outlive the profiler, usually a string literal
+    std::uint64_t start, end;
+    int depth;
+};
+
+struct FrameSample {
+    std::uint64_t index = 0;
+    std::uint64_t start = 0, end = 0;
+    double gpu_ms = -1.0; // negative until the GPU query has come back
+    std::vector<ZoneSample> zones;
+};
+
+
+class FrameProfiler {
+public:
+
+    static FrameProfiler& get() {
+        static FrameProfiler profiler;
+        return profiler;
+    }
+
+    void set_enabled(bool enable) {
+        enabled = enable;
+        open = false;
+        depth = 0;
+    }
+
+    bool is_enabled() const {
+        return enabled;
+    }
+
+    // Number of frames kept, older ones are overwritten.
+    void set_history(std::size_t frames) {
+        history.assign(std::max<std::size_t>(frames, 1), FrameSample());
+        recorded = 0;
+        open = false;
+    }
+
+
+    // Needs a current GL context, without one only CPU times are recorded.
+    void init_gpu() {
+        glGenQueries(query_count, queries);
+        for (auto& frame : query_frame) {
+            frame = no_frame;
+        }
+        gpu = true;
+    }
+
+    void release_gpu() {
+        if (gpu) {
+            glDeleteQueries(query_count, queries);
+            gpu = false;
+        }
+    }
+
+
+    // Starts a new frame, discarding one that was begun but never ended.
+    void begin_frame() {
+        if (!enabled) {
+            return;
+        }
+
+        FrameSample& frame = history[recorded % history.size()];
+        frame.index = recorded;
+        frame.start = SDL_GetPerformanceCounter();
+        frame.end = frame.start;
+        frame.gpu_ms = -1.0;
+        frame.zones.clear();
+
+        depth = 0;
+        open = true;
+    }
+
+    void end_frame() {
+        if (!open) {
+            return;
+        }
+
+        history[recorded % history.size()].end = SDL_GetPerformanceCounter();
+        ++recorded;
+        open = false;
+
+        read_queries();
+    }
+
+    // Brackets the GL commands of the open frame, skipped while the next query is still in flight.
+    void begin_gpu() {
+        if (!open || !gpu) {
+            return;
+        }
+
+        GLuint query = queries[recorded % query_count];
+        if (query_frame[recorded % query_count] != no_frame) {
+            return;
+        }
+        glBeginQuery(GL_TIME_ELAPSED, query);
+        query_frame[recorded % query_count] = recorded;
+        gpu_active = true;
+    }
+
+    void end_gpu() {
+        if (gpu_active) {
+            glEndQuery(GL_TIME_ELAPSED);
+            gpu_active = false;
+        }
+    }
+
+
+    void begin_zone(const char* name) {
+        if (open) {
+            auto& zones = history[recorded % history.size()].zones;
+            zones.push_back({ name, SDL_GetPerformanceCounter(), 0, depth++ });
+        }
+    }
+
+    void end_zone() {
+        if (!open || depth == 0) {
+            return;
+        }
+
+        // The innermost zone still open is the last one at depth - 1.
+        auto& zones = history[recorded % history.size()].zones;
+        --depth;
+        for (auto i = zones.rbegin(); i != zones.rend(); ++i) {
+            if (i->depth == depth) {
+                i->end = SDL_GetPerformanceCounter();
+                break;
+            }
+        }
+    }
+
+
+    // Number of finished frames available to get_frame.
+    std::size_t get_frame_count() const {
+        return (std::size_t)std::min<std::uint64_t>(recorded, history.size());
+    }
+
+    // The finished frame `age` frames ago, 0 being the latest.
+    const FrameSample& get_frame(std::size_t age) const {
+        return history[(recorded - 1 - age) % history.size()];
+    }
+
+    double to_ms(std::uint64_t ticks) const {
+        return ticks * 1000.0 / frequency;
+    }
+
+
+    // Bar graph of CPU time per frame with GPU time drawn over it, the line marks `budget_ms`.
+    void draw(Canvas& canvas, const glm::vec2& pos, const glm::vec2& size, double budget_ms = 1000.0 / 60.0, const std::string& font = "") {
+        const double range_ms = budget_ms * 2.0;
+        std::size_t count = get_frame_count();
+
+        canvas.begin_path();
+        canvas.rect(pos, size);
+        canvas.fill({ 0.0f, 0.0f, 0.0f, 0.5f });
+
+        float bar = size.x / history.size();
+        auto height = [&](double ms) {
+            return (float)std::min(ms / range_ms, 1.0) * size.y;
+        };
+
+        canvas.begin_path();
+        for (std::size_t age = 0; age < count; ++age) {
+            auto& frame = get_frame(age);
+            float h = height(to_ms(frame.end - frame.start));
+            canvas.rect({ pos.x + size.x - (age + 1) * bar, pos.y + size.y - h }, { bar, h });
+        }
+        canvas.fill({ 0.3f, 0.8f, 0.3f, 0.8f });
+
+        canvas.begin_path();
+        bool first = true;
+        for (std::size_t age = 0; age < count; ++age) {
+            auto& frame = get_frame(age);
+            if (frame.gpu_ms < 0.0) {
+                continue;
+            }
+            glm::vec2 p = { pos.x + size.x - (age + 0.5f) * bar, pos.y + size.y - height(frame.gpu_ms) };
+            if (first) {
+                canvas.move_to(p);
+                first = false;
+            } else {
+                canvas.line_to(p);
+            }
+        }
+        canvas.stroke({ 0.9f, 0.5f, 0.1f, 1.0f }, 1.0f);
+
+        canvas.begin_path();
+        canvas.move_to({ pos.x, pos.y + size.y - height(budget_ms) });
+        canvas.line_to({ pos.x + size.x, pos.y + size.y - height(budget_ms) });
+        canvas.stroke({ 1.0f, 0.2f, 0.2f, 0.8f }, 1.0f);
+
+        if (!font.empty() && count) {
+            auto& frame = get_frame(0);
+            char label[64];
+            snprintf(label, sizeof(label), "cpu %.2f ms  gpu %.2f ms", to_ms(frame.end - frame.start), std::max(frame.gpu_ms, 0.0));
+
+            canvas.set_font(font, 14);
+            canvas.text(pos + glm::vec2(4, 4), label, { 1.0f, 1.0f, 1.0f, 1.0f }, Align::top | Align::left);
+        }
+    }
+
+
+    // Startup and every recorded frame in Chrome's trace event format, load it in chrome://tracing.
+    json to_chrome_trace() const {
+        json events = json::array();
+        auto us = [&](std::uint64_t ticks) {
+            return (ticks - epoch) * 1000000.0 / frequency;
+        };
+
+        auto& startup = StartupTrace::get();
+        for (auto& phase : startup.get_phases()) {
+            std::uint64_t end = phase.end ? phase.end : phase.start;
+            events.push_back({ { "name", phase.name }, { "ph", "X" }, { "pid", 0 }, { "tid", 0 },
+                               { "ts", us(phase.start) }, { "dur", us(end) - us(phase.start) } });
+        }
+        if (startup.is_complete()) {
+            events.push_back({ { "name", "first frame" }, { "ph", "i" }, { "s", "g" }, { "pid", 0 }, { "tid", 0 },
+                               { "ts", us(startup.get_first_frame()) },
+                               { "args", { { "ms", startup.get_time_to_first_frame_ms() } } } });
+        }
+
+        for (std::size_t age = get_frame_count(); age-- > 0;) {
+            auto& frame = get_frame(age);
+            events.push_back({ { "name", "frame" }, { "ph", "X" }, { "pid", 0 }, { "tid", 0 },
+                               { "ts", us(frame.start) }, { "dur", us(frame.end) - us(frame.start) },
+                               { "args", { { "index", frame.index } } } });
+
+            for (auto& zone : frame.zones) {
+                std::uint64_t end = zone.end ? zone.end : frame.end;
+                events.push_back({ { "name", zone.name }, { "ph", "X" }, { "pid", 0 }, { "tid", 0 },
+                                   { "ts", us(zone.start) }, { "dur", us(end) - us(zone.start) } });
+            }
+
+            // GPU work is not timestamped, show it on its own track from the start of the frame.
+            if (frame.gpu_ms >= 0.0) {
+                events.push_back({ { "name", "gpu" }, { "ph", "X" }, { "pid", 0 }, { "tid", 1 },
+                                   { "ts", us(frame.start) }, { "dur", frame.gpu_ms * 1000.0 } });
+            }
+        }
+
+        return { { "traceEvents", events }, { "displayTimeUnit", "ms" } };
+    }
+
+    bool write_chrome_trace(const std::string& filename) const {
+        std::ofstream out(filename);
+        if (!out) {
+            printf("Error opening trace file '%s' for writing\n", filename.c_str());
+            return false;
+        }
+        out << to_chrome_trace().dump();
+        return true;
+    }
+
+private:
+
+    static const int query_count = 4;
+    static const std::uint64_t no_frame = ~0ull;
+
+    // Shares the startup trace's epoch so startup and frames line up in one trace.
+    FrameProfiler() : frequency(SDL_GetPerformanceFrequency()), epoch(StartupTrace::get().get_epoch()) {
+        set_history(240);
+    }
+
+    // Collects finished GPU queries without blocking.
+    void read_queries() {
+        if (!gpu) {
+            return;
+        }
+
+        for (int i = 0; i < query_count; ++i) {
+            if (query_frame[i] == no_frame) {
+                continue;
+            }
+
+            GLint available = 0;
+            glGetQueryObjectiv(queries[i], GL_QUERY_RESULT_AVAILABLE, &available);
+            if (!available) {
+                continue;
+            }
+
+            GLuint64 ns = 0;
+            glGetQueryObjectui64v(queries[i], GL_QUERY_RESULT, &ns);
+
+            // The frame may have been overwritten by now if the history is very short.
+            FrameSample& frame = history[query_frame[i] % history.size()];
+            if (frame.index == query_frame[i]) {
+                frame.gpu_ms = ns / 1000000.0;
+            }
+            query_frame[i] = no_frame;
+        }
+    }
+
+    bool enabled = false;
+    bool open = false;
+    int depth = 0;
+
+    std::vector<FrameSample> history;
+    std::uint64_t recorded = 0;
+
+    bool gpu = false, gpu_active = false;
+    GLuint queries[query_count];
+    std::uint64_t query_frame[query_count];
+
+    std::uint64_t frequency, epoch;
+};
+
+
+// Times the enclosing scope as a zone of the current frame.
+class ProfileZone {
+public:
+    ProfileZone(const char* name) {
+        FrameProfiler::get().begin_zone(name);
+    }
+
+    ~ProfileZone() {
+        FrameProfiler::get().end_zone();
+    }
+
+    ProfileZone(const ProfileZone&) = delete;
+    void operator=(const ProfileZone&) = delete;
+};
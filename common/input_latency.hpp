@@ -0,0 +1,106 @@
+#pragma once
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <mutex>
+#include <vector>
+
+#include <SDL.h>
+
+struct LatencyReport {
+    std::size_t count = 0;
+    double mean = 0.0, p50 = 0.0, p95 = 0.0, p99 = 0.0, max = 0.0;
+
+    void print(const char* name) const {
+        printf("%s latency over %zu frames: mean %.2f ms, p50 %.2f ms, p95 %.2f ms, p99 %.2f ms, max %.2f ms\n",
+               name, count, mean, p50, p95, p99, max);
+    }
+};
+
+
+/*
+    Latency samples of the last N presented frames, each one the time from the oldest input
+    a frame consumed to the moment its present returned. Samples may be added from the render
+    thread, so everything is behind a lock, it is taken once per frame at most.
+*/
+class LatencyMeter {
+public:
+
+    LatencyMeter() : frequency(SDL_GetPerformanceFrequency()) {
+        set_history(1024);
+    }
+
+    void set_history(std::size_t frames) {
+        std::lock_guard<std::mutex> lock(mutex);
+        samples.assign(std::max<std::size_t>(frames, 1), 0.0);
+        recorded = 0;
+    }
+
+    // `input` and `presented` are SDL performance counter values, nothing is recorded without input.
+    void add(std::uint64_t input, std::uint64_t presented) {
+        if (!input || presented < input) {
+            return;
+        }
+
+        std::lock_guard<std::mutex> lock(mutex);
+        samples[recorded % samples.size()] = (presented - input) * 1000.0 / frequency;
+        ++recorded;
+    }
+
+    void clear() {
+        std::lock_guard<std::mutex> lock(mutex);
+        recorded = 0;
+    }
+
+    LatencyReport get_report() const {
+        std::vector<double> sorted;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            sorted.assign(samples.begin(), samples.begin() + (std::size_t)std::min<std::uint64_t>(recorded, samples.size()));
+        }
+
+        LatencyReport report;
+        if (sorted.empty()) {
+            return report;
+        }
+        std::sort(sorted.begin(), sorted.end());
+
+        // Nearest rank, the smallest sample at least `p` of all samples are at or below.
+        auto percentile = [&](double p) {
+            std::size_t rank = (std::size_t)std::ceil(p * sorted.size());
+            return sorted[std::min(std::max<std::size_t>(rank, 1), sorted.size()) - 1];
+        };
+
+        report.count = sorted.size();
+        for (double ms : sorted) {
+            report.mean += ms;
+        }
+        report.mean /= sorted.size();
+        report.p50 = percentile(0.50);
+        report.p95 = percentile(0.95);
+        report.p99 = percentile(0.99);
+        report.max = sorted.back();
+        return report;
+    }
+
+    /*
+        Converts an SDL event timestamp to the performance counter. Timestamps only have
+        millisecond resolution and come from SDL_GetTicks, so the age of the event is taken in
+        ticks and subtracted from the precise current time.
+    */
+    static std::uint64_t from_timestamp(Uint32 timestamp) {
+        std::uint64_t now = SDL_GetPerformanceCounter();
+        Uint32 ticks = SDL_GetTicks();
+        Uint32 age = SDL_TICKS_PASSED(ticks, timestamp) ? ticks - timestamp : 0;
+        std::uint64_t back = (std::uint64_t)age * SDL_GetPerformanceFrequency() / 1000;
+        return back < now ? now - back : now;
+    }
+
+private:
+
+    mutable std::mutex mutex;
+    std::vector<double> samples;
+    std::uint64_t recorded = 0;
+    std::uint64_t frequency;
+};
@@ -0,0 +1,259 @@
+#pragma once
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <fstream>
+#include <functional>
+#include <string>
+#include <vector>
+
+#include <SDL.h>
+
+/*
+    Binary log of the SDL events Window consumes, grouped into frames. Every record is a one
+    byte tag and a 32 bit SDL timestamp followed by the fields Window actually reads, all in
+    host byte order.
+*/
+namespace input_log {
+
+    const char magic[4] = { 'Z', 'I', 'N', 'P' };
+    const std::uint32_t version = 1;
+
+    enum Tag : std::uint8_t {
+        frame,
+        quit,
+        key_down,
+        key_up,
+        button_down,
+        button_up,
+        motion,
+        resized
+    };
+
+}
+
+
+class InputRecorder {
+public:
+
+    bool open(const std::string& filename) {
+        out.open(filename, std::ios::binary);
+        if (!out) {
+            printf("Error opening input log '%s' for writing\n", filename.c_str());
+            return false;
+        }
+        out.write(input_log::magic, sizeof(input_log::magic));
+        write(input_log::version);
+        return true;
+    }
+
+    void begin_frame() {
+        write_header(input_log::frame, SDL_GetTicks());
+    }
+
+    void record(const SDL_Event& event) {
+        switch (event.type) {
+        case SDL_QUIT:
+            write_header(input_log::quit, event.common.timestamp);
+            break;
+
+        case SDL_KEYDOWN:
+        case SDL_KEYUP:
+            write_header(event.type == SDL_KEYDOWN ? input_log::key_down : input_log::key_up, event.common.timestamp);
+            write<std::int32_t>(event.key.keysym.sym);
+            write<std::int32_t>(event.key.keysym.scancode);
+            write<std::uint16_t>(event.key.keysym.mod);
+            write<std::uint8_t>(event.key.repeat);
+            break;
+
+        case SDL_MOUSEBUTTONDOWN:
+        case SDL_MOUSEBUTTONUP:
+            write_header(event.type == SDL_MOUSEBUTTONDOWN ? input_log::button_down : input_log::button_up, event.common.timestamp);
+            write<std::uint8_t>(event.button.button);
+            write<std::uint8_t>(event.button.clicks);
+            write<std::int32_t>(event.button.x);
+            write<std::int32_t>(event.button.y);
+            break;
+
+        case SDL_MOUSEMOTION:
+            write_header(input_log::motion, event.common.timestamp);
+            write<std::uint32_t>(event.motion.state);
+            write<std::int32_t>(event.motion.x);
+            write<std::int32_t>(event.motion.y);
+            write<std::int32_t>(event.motion.xrel);
+            write<std::int32_t>(event.motion.yrel);
+            break;
+
+        case SDL_WINDOWEVENT:
+            if (event.window.event == SDL_WINDOWEVENT_RESIZED) {
+                write_header(input_log::resized, event.common.timestamp);
+                write<std::int32_t>(event.window.data1);
+                write<std::int32_t>(event.window.data2);
+            }
+            break;
+        }
+    }
+
+private:
+
+    template <class T>
+    void write(const T& value) {
+        out.write(reinterpret_cast<const char*>(&value), sizeof(T));
+    }
+
+    void write_header(input_log::Tag tag, std::uint32_t timestamp) {
+        write<std::uint8_t>(tag);
+        write(timestamp);
+    }
+
+    std::ofstream out;
+};
+
+
+class InputLog {
+public:
+
+    struct Frame {
+        std::uint32_t timestamp;
+        std::vector<SDL_Event> events;
+    };
+
+    bool load(const std::string& filename) {
+        std::ifstream in(filename, std::ios::binary);
+
+        char magic[4];
+        std::uint32_t version = 0;
+        in.read(magic, sizeof(magic));
+        read(in, version);
+        if (!in || !std::equal(magic, magic + 4, input_log::magic) || version != input_log::version) {
+            printf("Error reading input log '%s'\n", filename.c_str());
+            return false;
+        }
+
+        frames.clear();
+
+        std::uint8_t tag;
+        std::uint32_t timestamp;
+        while (read(in, tag) && read(in, timestamp)) {
+            if (tag == input_log::frame) {
+                frames.push_back({ timestamp, {} });
+                continue;
+            }
+
+            SDL_Event event;
+            SDL_zero(event);
+            event.common.timestamp = timestamp;
+
+            if (!decode(in, (input_log::Tag)tag, event)) {
+                printf("Corrupt record in input log '%s'\n", filename.c_str());
+                return false;
+            }
+
+            // Events logged before the first frame marker still belong to a frame.
+            if (frames.empty()) {
+                frames.push_back({ timestamp, {} });
+            }
+            frames.back().events.push_back(event);
+        }
+        return true;
+    }
+
+    const std::vector<Frame>& get_frames() const {
+        return frames;
+    }
+
+private:
+
+    template <class T>
+    static bool read(std::istream& in, T& value) {
+        return (bool)in.read(reinterpret_cast<char*>(&value), sizeof(T));
+    }
+
+    template <class T, class U>
+    static void read_into(std::istream& in, U& field) {
+        T value = 0;
+        read(in, value);
+        field = static_cast<U>(value);
+    }
+
+    static bool decode(std::istream& in, input_log::Tag tag, SDL_Event& event) {
+        switch (tag) {
+        case input_log::quit:
+            event.type = SDL_QUIT;
+            break;
+
+        case input_log::key_down:
+        case input_log::key_up:
+            event.type = tag == input_log::key_down ? SDL_KEYDOWN : SDL_KEYUP;
+            event.key.state = tag == input_log::key_down ? SDL_PRESSED : SDL_RELEASED;
+            read_into<std::int32_t>(in, event.key.keysym.sym);
+            read_into<std::int32_t>(in, event.key.keysym.scancode);
+            read_into<std::uint16_t>(in, event.key.keysym.mod);
+            read_into<std::uint8_t>(in, event.key.repeat);
+            break;
+
+        case input_log::button_down:
+        case input_log::button_up:
+            event.type = tag == input_log::button_down ? SDL_MOUSEBUTTONDOWN : SDL_MOUSEBUTTONUP;
+            event.button.state = tag == input_log::button_down ? SDL_PRESSED : SDL_RELEASED;
+            read_into<std::uint8_t>(in, event.button.button);
+            read_into<std::uint8_t>(in, event.button.clicks);
+            read_into<std::int32_t>(in, event.button.x);
+            read_into<std::int32_t>(in, event.button.y);
+            break;
+
+        case input_log::motion:
+            event.type = SDL_MOUSEMOTION;
+            read_into<std::uint32_t>(in, event.motion.state);
+            read_into<std::int32_t>(in, event.motion.x);
+            read_into<std::int32_t>(in, event.motion.y);
+            read_into<std::int32_t>(in, event.motion.xrel);
+            read_into<std::int32_t>(in, event.motion.yrel);
+            break;
+
+        case input_log::resized:
+            event.type = SDL_WINDOWEVENT;
+            event.window.event = SDL_WINDOWEVENT_RESIZED;
+            read_into<std::int32_t>(in, event.window.data1);
+            read_into<std::int32_t>(in, event.window.data2);
+            break;
+
+        default:
+            return false;
+        }
+        return (bool)in;
+    }
+
+    std::vector<Frame> frames;
+};
+
+
+/*
+    Per frame CPU times collected while replaying an InputLog.
+*/
+struct ReplayReport {
+    std::vector<double> frame_ms;
+
+    void print() const {
+        if (frame_ms.empty()) {
+            printf("replay: no frames\n");
+            return;
+        }
+
+        std::vector<double> sorted = frame_ms;
+        std::sort(sorted.begin(), sorted.end());
+
+        double total = 0.0;
+        for (double t : sorted) {
+            total += t;
+        }
+
+        auto percentile = [&](double p) {
+            return sorted[std::min(sorted.size() - 1, (std::size_t)(p * sorted.size()))];
+        };
+
+        printf("replay: %zu frames, %.2f ms total\n", sorted.size(), total);
+        printf("  mean %.3f ms  p50 %.3f ms  p95 %.3f ms  p99 %.3f ms  max %.3f ms\n",
+               total / sorted.size(), percentile(0.5), percentile(0.95), percentile(0.99), sorted.back());
+    }
+};
@@ -0,0 +1,191 @@
+#pragma once
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <unordered_map>
+
+#include <GL/glew.h>
+#include <nanovg.h>
+
+#include "canvas.hpp"
+
+#ifndef NANOVG_GL3
+#error "layer_cache.hpp needs the nanovg GL3 backend, include it through window.hpp"
+#endif
+
+/*
+    Textures holding rendered Canvas subtrees for Canvas::layer. Layers are drawn with a
+    nanovg context of their own, so one can be re-rendered in the middle of a frame without
+    flushing the frame being built, and are shared with the window's context as images.
+    Memory is capped by a byte budget, the least recently drawn layers are evicted first.
+*/
+class LayerCache : public LayerProvider {
+public:
+
+    LayerCache() { }
+
+    LayerCache(const LayerCache&) = delete;
+    void operator=(const LayerCache&) = delete;
+
+    // `canvas` is the window's canvas the layers are drawn into, it needs a current GL context.
+    void create(const Canvas& canvas, int flags) {
+        target = canvas;
+        ctx = nvgCreateGL3(flags);
+        layer_canvas = Canvas(ctx);
+    }
+
+    void destroy() {
+        clear();
+        if (ctx) {
+            nvgDeleteGL3(ctx);
+            ctx = nullptr;
+        }
+    }
+
+    void set_budget(std::size_t bytes) {
+        budget = bytes;
+        evict(0);
+    }
+
+    std::size_t get_usage() const {
+        return usage;
+    }
+
+    // Drops a layer, it is rendered again the next time it is drawn.
+    void invalidate(const std::string& key) {
+        auto layer = layers.find(key);
+        if (layer != layers.end()) {
+            release(layer->second);
+            layers.erase(layer);
+        }
+    }
+
+    void clear() {
+        for (auto& layer : layers) {
+            release(layer.second);
+        }
+        layers.clear();
+    }
+
+    // Layers drawn since the last call are in use by the frame being built and are never evicted.
+    void begin_frame() {
+        ++frame;
+    }
+
+    int get_layer(const std::string& key, const glm::ivec2& pixels, std::uint64_t version,
+                  const glm::vec2& size, const std::function<void(Canvas&)>& draw) override {
+        if (!ctx || pixels.x <= 0 || pixels.y <= 0) {
+            return 0;
+        }
+
+        auto found = layers.find(key);
+        if (found != layers.end() && found->second.pixels != pixels) {
+            release(found->second);
+            layers.erase(found);
+            found = layers.end();
+        }
+
+        if (found == layers.end()) {
+            std::size_t bytes = get_bytes(pixels);
+            if (!evict(bytes)) {
+                return 0;
+            }
+
+            Layer layer;
+            layer.pixels = pixels;
+            layer.framebuffer = nvgluCreateFramebuffer(ctx, pixels.x, pixels.y, 0);
+            if (!layer.framebuffer) {
+                return 0;
+            }
+
+            // The window's context only borrows the texture, the framebuffer owns it.
+            layer.image = nvglCreateImageFromHandleGL3(target.get_context(), layer.framebuffer->texture, pixels.x, pixels.y,
+                                                       NVG_IMAGE_FLIPY | NVG_IMAGE_PREMULTIPLIED | NVG_IMAGE_NODELETE);
+            usage += bytes;
+            found = layers.emplace(key, layer).first;
+        }
+
+        Layer& layer = found->second;
+        layer.last_used = frame;
+
+        if (!layer.rendered || layer.version != version) {
+            render(layer, size, draw);
+            layer.version = version;
+            layer.rendered = true;
+        }
+        return layer.image;
+    }
+
+private:
+
+    struct Layer {
+        NVGLUframebuffer* framebuffer = nullptr;
+        int image = 0;
+        glm::ivec2 pixels;
+        std::uint64_t version = 0;
+        std::uint64_t last_used = 0;
+        bool rendered = false;
+    };
+
+    // RGBA colour plus the 8 bit stencil nanovg fills with.
+    static std::size_t get_bytes(const glm::ivec2& pixels) {
+        return (std::size_t)pixels.x * pixels.y * 5;
+    }
+
+    void release(Layer& layer) {
+        nvgDeleteImage(target.get_context(), layer.image);
+        nvgluDeleteFramebuffer(layer.framebuffer);
+        usage -= get_bytes(layer.pixels);
+    }
+
+    // Frees least recently used layers until `bytes` more fit, false if the layers in use already fill the budget.
+    bool evict(std::size_t bytes) {
+        while (usage + bytes > budget) {
+            auto victim = layers.end();
+            for (auto i = layers.begin(); i != layers.end(); ++i) {
+                if (i->second.last_used != frame && (victim == layers.end() || i->second.last_used < victim->second.last_used)) {
+                    victim = i;
+                }
+            }
+            if (victim == layers.end()) {
+                return false;
+            }
+            release(victim->second);
+            layers.erase(victim);
+        }
+        return true;
+    }
+
+    // Draws into the layer and puts back the framebuffer, viewport and clear colour the frame was using.
+    void render(Layer& layer, const glm::vec2& size, const std::function<void(Canvas&)>& draw) {
+        GLint framebuffer = 0, viewport[4];
+        GLfloat clear_color[4];
+        glGetIntegerv(GL_FRAMEBUFFER_BINDING, &framebuffer);
+        glGetIntegerv(GL_VIEWPORT, viewport);
+        glGetFloatv(GL_COLOR_CLEAR_VALUE, clear_color);
+
+        layer_canvas.sync_fonts(target);
+
+        nvgluBindFramebuffer(layer.framebuffer);
+        glViewport(0, 0, layer.pixels.x, layer.pixels.y);
+        glClearColor(0.0f, 0.0f, 0.0f, 0.0f);
+        glClear(GL_COLOR_BUFFER_BIT | GL_STENCIL_BUFFER_BIT);
+
+        layer_canvas.begin_frame(glm::ivec2(glm::ceil(size)), layer.pixels.x / size.x);
+        draw(layer_canvas);
+        layer_canvas.end_frame();
+
+        glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+        glViewport(viewport[0], viewport[1], viewport[2], viewport[3]);
+        glClearColor(clear_color[0], clear_color[1], clear_color[2], clear_color[3]);
+    }
+
+    NVGcontext* ctx = nullptr;
+    Canvas target;
+    Canvas layer_canvas;
+
+    std::unordered_map<std::string, Layer> layers;
+    std::size_t budget = 64 * 1024 * 1024;
+    std::size_t usage = 0;
+    std::uint64_t frame = 0;
+};
@@ -0,0 +1,77 @@
+#pragma once
+#include <atomic>
+#include <functional>
+#include <vector>
+
+#include "display_list.hpp"
+#include "worker_pool.hpp"
+
+/*
+    Records independent parts of a frame (panels, subtrees) into display lists on a pool of
+    worker threads, the calling thread joins in. Part `i` always records into list `i` whichever
+    thread picks it up, and the lists are replayed or merged in index order, so the frame comes
+    out the same however the work was split. Lists are only cleared between frames, each one
+    keeps its buffers and stops allocating once it has seen its largest part.
+*/
+class RecordPool {
+public:
+    typedef std::function<void(std::size_t index, DisplayList& list)> Recorder;
+
+    // `threads` counts the caller, 0 uses every core.
+    explicit RecordPool(std::size_t threads = 0) : pool(threads) { }
+
+    void set_threads(std::size_t threads) {
+        pool.set_threads(threads);
+    }
+
+    std::size_t get_threads() const {
+        return pool.get_threads();
+    }
+
+    // Calls `recorder` once for every index below `count` and returns once all of them are done.
+    void record(std::size_t count, const Recorder& recorder) {
+        if (lists.size() < count) {
+            lists.resize(count);
+        }
+        for (std::size_t i = 0; i < count; ++i) {
+            lists[i].clear();
+        }
+        recorded = count;
+
+        next = 0;
+        pool.run([&](std::size_t) {
+            for (std::size_t i = next++; i < count; i = next++) {
+                recorder(i, lists[i]);
+            }
+        });
+    }
+
+    std::size_t size() const {
+        return recorded;
+    }
+
+    const DisplayList& get(std::size_t index) const {
+        return lists[index];
+    }
+
+    // Draws the lists of the last record, in order. Main thread only, like any Canvas.
+    void replay(Canvas& canvas) const {
+        for (std::size_t i = 0; i < recorded; ++i) {
+            lists[i].replay(canvas);
+        }
+    }
+
+    // Appends the lists of the last record to `frame`, in order.
+    void merge(DisplayList& frame) const {
+        for (std::size_t i = 0; i < recorded; ++i) {
+            frame.append(lists[i]);
+        }
+    }
+
+private:
+    WorkerPool pool;
+    std::atomic<std::size_t> next{ 0 };
+
+    std::vector<DisplayList> lists;
+    std::size_t recorded = 0;
+};
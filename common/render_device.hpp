@@ -0,0 +1,146 @@
+#pragma once
+#include <algorithm>
+#include <vector>
+
+#include <SDL.h>
+#include <GL/glew.h>
+#include <nanovg.h>
+
+#include "canvas.hpp"
+#include "frame_profiler.hpp"
+#include "layer_cache.hpp"
+#include "render_profile.hpp"
+
+#ifndef NANOVG_GL3
+#error "render_device.hpp needs the nanovg GL3 backend, include it through window.hpp"
+#endif
+
+/*
+    The GL context, nanovg context and layer cache that one or more windows draw with. Fonts,
+    images, the glyph atlas and cached layers exist once here however many windows share the
+    device, each window only keeps its own frame state (size, pacing, damage, offscreen
+    targets) and makes the context current on itself while it draws.
+*/
+class RenderDevice {
+public:
+
+    // Takes ownership of `context`, made on a window with `samples` MSAA. `canvas` is the one the first window hands out.
+    RenderDevice(SDL_GLContext context, const Canvas& canvas, RenderProfile profile, int samples)
+        : gl_context(context), canvas(canvas), profile(profile), samples(samples) { }
+
+    RenderDevice(const RenderDevice&) = delete;
+    void operator=(const RenderDevice&) = delete;
+
+    ~RenderDevice() {
+        SDL_GL_DeleteContext(gl_context);
+    }
+
+    // nanovg, the layer cache and GPU timers, the context must be current.
+    void create() {
+        int flags = RenderSettings::get(profile).nvg_flags;
+        canvas.set_context(nvgCreateGL3(flags));
+
+        layers.create(canvas, flags);
+        canvas.set_layer_provider(&layers);
+
+        FrameProfiler::get().init_gpu();
+    }
+
+    // Undoes create, the context must be current on one of the windows.
+    void release() {
+        if (!canvas.get_context()) {
+            return;
+        }
+        layers.destroy();
+        FrameProfiler::get().release_gpu();
+        nvgDeleteGL3(canvas.get_context());
+        canvas.set_context(nullptr);
+    }
+
+
+    void attach(SDL_Window* window) {
+        windows.push_back(window);
+        current = window;
+    }
+
+    // Returns how many windows are left on the device.
+    std::size_t detach(SDL_Window* window) {
+        windows.erase(std::remove(windows.begin(), windows.end(), window), windows.end());
+        if (current == window) {
+            current = nullptr;
+        }
+        if (interval_window == window) {
+            interval_window = nullptr;
+        }
+        return windows.size();
+    }
+
+    std::size_t get_window_count() const {
+        return windows.size();
+    }
+
+    // Only switches when another window had the context last.
+    void make_current(SDL_Window* window) {
+        if (window != current) {
+            SDL_GL_MakeCurrent(window, gl_context);
+            current = window;
+        }
+    }
+
+
+    /*
+        Swaps `window`, which must be current, with its own swap interval. Depending on the
+        platform the interval belongs to the context or to the window, so with windows wanting
+        different ones it is set again whenever another window or interval comes along.
+    */
+    void present(SDL_Window* window, int swap_interval) {
+        if (window != interval_window || swap_interval != interval) {
+            SDL_GL_SetSwapInterval(swap_interval);
+            interval_window = window;
+            interval = swap_interval;
+        }
+        SDL_GL_SwapWindow(window);
+    }
+
+
+    SDL_GLContext get_gl_context() const {
+        return gl_context;
+    }
+
+    Canvas& get_canvas() {
+        return canvas;
+    }
+
+    LayerCache& get_layers() {
+        return layers;
+    }
+
+    RenderProfile get_profile() const {
+        return profile;
+    }
+
+    // Takes effect with the next create, the sample count stays what the context was made with.
+    void set_profile(RenderProfile p) {
+        profile = p;
+    }
+
+    // Windows sharing the device need the same MSAA so their pixel formats match the context.
+    int get_samples() const {
+        return samples;
+    }
+
+private:
+    SDL_GLContext gl_context;
+    Canvas canvas;
+    LayerCache layers;
+
+    RenderProfile profile;
+    int samples;
+
+    std::vector<SDL_Window*> windows;
+    SDL_Window* current = nullptr;
+
+    // What present last set the swap interval to, and for which window.
+    SDL_Window* interval_window = nullptr;
+    int interval = 0;
+};
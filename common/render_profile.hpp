@@ -0,0 +1,63 @@
+#pragma once
+#include <cstring>
+#include <initializer_list>
+
+#include <nanovg.h>
+
+#ifndef NANOVG_GL3
+#error "render_profile.hpp needs the nanovg GL3 backend, include it through window.hpp"
+#endif
+
+/*
+    How much the window spends on antialiasing. nanovg's edge antialiasing only costs a thin
+    fringe of extra geometry per shape, MSAA multiplies the fill rate for the whole window but
+    also smooths intersecting edges. MSAA only reaches the window itself, offscreen targets
+    (layers, the scaled scene, the retained frame) rely on nanovg's antialiasing, so quality
+    keeps both.
+*/
+enum class RenderProfile {
+    performance, // no antialiasing, strokes are tessellated
+    balanced,    // nanovg edge antialiasing
+    quality      // 4x MSAA on top of nanovg antialiasing, with stencilled strokes so overlaps blend correctly
+};
+
+// What a profile asks of the window's framebuffer and of nanovg.
+struct RenderSettings {
+    int msaa_samples;
+    int nvg_flags;
+
+    static RenderSettings get(RenderProfile profile) {
+        RenderSettings settings = { 0, 0 };
+        switch (profile) {
+        case RenderProfile::performance: settings = { 0, 0 }; break;
+        case RenderProfile::balanced: settings = { 0, NVG_ANTIALIAS }; break;
+        case RenderProfile::quality: settings = { 4, NVG_ANTIALIAS | NVG_STENCIL_STROKES }; break;
+        }
+
+#ifndef NDEBUG
+        // GL error checks after every nanovg flush, too slow for release builds.
+        settings.nvg_flags |= NVG_DEBUG;
+#endif
+        return settings;
+    }
+};
+
+inline const char* to_string(RenderProfile profile) {
+    switch (profile) {
+    case RenderProfile::performance: return "performance";
+    case RenderProfile::balanced: return "balanced";
+    case RenderProfile::quality: return "quality";
+    }
+    return "";
+}
+
+// Parses a profile name, leaves `profile` alone and returns false for anything else.
+inline bool from_string(const char* name, RenderProfile& profile) {
+    for (RenderProfile p : { RenderProfile::performance, RenderProfile::balanced, RenderProfile::quality }) {
+        if (std::strcmp(name, to_string(p)) == 0) {
+            profile = p;
+            return true;
+        }
+    }
+    return false;
+}
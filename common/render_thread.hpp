@@ -0,0 +1,497 @@
+#pragma once
+#include <algorithm>
+#include <condition_variable>
+#include <cstdint>
+#include <cstring>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include <SDL.h>
+#include <GL/glew.h>
+#include <nanovg.h>
+#include <glm/glm.hpp>
+
+/*
+    One frame worth of nanovg backend calls, with the paths and vertices copied out of
+    nanovg's cache so they can be replayed on another thread after nanovg moved on.
+    Texture ids in here are the recorder's own, the render thread maps them to real ones.
+*/
+struct CommandList {
+    enum Type : std::uint8_t {
+        viewport,
+        fill,
+        stroke,
+        triangles,
+        create_texture,
+        update_texture,
+        delete_texture
+    };
+
+    struct Command {
+        Type type;
+        int image;
+
+        // Draw calls
+        NVGpaint paint;
+        NVGcompositeOperationState composite;
+        NVGscissor scissor;
+        float fringe, stroke_width;
+        float bounds[4];
+        std::size_t first, count; // into paths, or into vertices for triangles
+
+        // Viewport and texture calls
+        int texture_type, flags;
+        int x, y, width, height;
+        float ratio;
+        std::size_t data; // offset into bytes, npos without pixel data
+    };
+
+    // NVGpath with its vertex pointers turned into offsets into `vertices`.
+    struct Path {
+        NVGpath path;
+        std::size_t fill, stroke;
+    };
+
+    static const std::size_t npos = ~(std::size_t)0;
+
+    std::vector<Command> commands;
+    std::vector<Path> paths;
+    std::vector<NVGvertex> vertices;
+    std::vector<unsigned char> bytes;
+
+    glm::vec4 clear_color;
+    bool frame = false; // set once the list holds a whole frame ending in nvgEndFrame
+
+    // Performance counter values of the oldest input the frame consumed and of its late latch, 0 for none.
+    std::uint64_t input_time = 0, latch_time = 0;
+
+    void clear() {
+        commands.clear();
+        paths.clear();
+        vertices.clear();
+        bytes.clear();
+        frame = false;
+        input_time = 0;
+        latch_time = 0;
+    }
+};
+
+
+/*
+    A nanovg backend that draws nothing and records every call into a CommandList instead.
+    Canvas code runs against it unchanged on the update thread.
+*/
+class CanvasRecorder {
+public:
+
+    // `antialias` should match the NVG_ANTIALIAS flag of the backend the lists are replayed into.
+    static NVGcontext* create(bool antialias) {
+        NVGparams params;
+        std::memset(&params, 0, sizeof(params));
+
+        params.userPtr = new CanvasRecorder();
+        params.edgeAntiAlias = antialias ? 1 : 0;
+        params.renderCreate = [](void*) { return 1; };
+        params.renderCreateTexture = &render_create_texture;
+        params.renderDeleteTexture = &render_delete_texture;
+        params.renderUpdateTexture = &render_update_texture;
+        params.renderGetTextureSize = &render_get_texture_size;
+        params.renderViewport = &render_viewport;
+        params.renderCancel = &render_cancel;
+        params.renderFlush = [](void* uptr) { get(uptr).list.frame = true; };
+        params.renderFill = &render_fill;
+        params.renderStroke = &render_stroke;
+        params.renderTriangles = &render_triangles;
+        params.renderDelete = [](void* uptr) { delete &get(uptr); };
+
+        return nvgCreateInternal(&params);
+    }
+
+    static CanvasRecorder& get(NVGcontext* ctx) {
+        return get(nvgInternalParams(ctx)->userPtr);
+    }
+
+    CommandList& get_list() {
+        return list;
+    }
+
+private:
+
+    struct Texture {
+        int type, width, height;
+        bool live;
+    };
+
+    static CanvasRecorder& get(void* uptr) {
+        return *static_cast<CanvasRecorder*>(uptr);
+    }
+
+    CommandList::Command& add(CommandList::Type type) {
+        list.commands.push_back(CommandList::Command());
+        auto& command = list.commands.back();
+        command.type = type;
+        command.data = CommandList::npos;
+        return command;
+    }
+
+    std::size_t add_bytes(const unsigned char* data, std::size_t size) {
+        std::size_t offset = list.bytes.size();
+        list.bytes.insert(list.bytes.end(), data, data + size);
+        return offset;
+    }
+
+    static int bytes_per_pixel(int type) {
+        return type == NVG_TEXTURE_RGBA ? 4 : 1;
+    }
+
+    static int render_create_texture(void* uptr, int type, int w, int h, int flags, const unsigned char* data) {
+        auto& r = get(uptr);
+        r.textures.push_back({ type, w, h, true });
+
+        auto& command = r.add(CommandList::create_texture);
+        command.image = (int)r.textures.size(); // ids start at 1, 0 means no image to nanovg
+        command.texture_type = type;
+        command.flags = flags;
+        command.width = w;
+        command.height = h;
+        if (data) {
+            command.data = r.add_bytes(data, (std::size_t)w * h * bytes_per_pixel(type));
+        }
+        return command.image;
+    }
+
+    static int render_delete_texture(void* uptr, int image) {
+        auto& r = get(uptr);
+        if (image < 1 || image > (int)r.textures.size() || !r.textures[image - 1].live) {
+            return 0;
+        }
+        r.textures[image - 1].live = false;
+        r.add(CommandList::delete_texture).image = image;
+        return 1;
+    }
+
+    // nanovg hands over the whole image and a dirty rectangle, only the dirty rows are copied.
+    static int render_update_texture(void* uptr, int image, int x, int y, int w, int h, const unsigned char* data) {
+        auto& r = get(uptr);
+        if (image < 1 || image > (int)r.textures.size()) {
+            return 0;
+        }
+
+        auto& texture = r.textures[image - 1];
+        std::size_t stride = (std::size_t)texture.width * bytes_per_pixel(texture.type);
+        std::size_t offset = r.add_bytes(data + y * stride, h * stride);
+
+        auto& command = r.add(CommandList::update_texture);
+        command.image = image;
+        command.x = x;
+        command.y = y;
+        command.width = w;
+        command.height = h;
+        command.data = offset;
+        return 1;
+    }
+
+    static int render_get_texture_size(void* uptr, int image, int* w, int* h) {
+        auto& r = get(uptr);
+        if (image < 1 || image > (int)r.textures.size()) {
+            return 0;
+        }
+        *w = r.textures[image - 1].width;
+        *h = r.textures[image - 1].height;
+        return 1;
+    }
+
+    static void render_viewport(void* uptr, float width, float height, float ratio) {
+        auto& command = get(uptr).add(CommandList::viewport);
+        command.width = (int)width;
+        command.height = (int)height;
+        command.ratio = ratio;
+    }
+
+    // Drops the draw calls of the cancelled frame, texture changes already happened.
+    static void render_cancel(void* uptr) {
+        auto& commands = get(uptr).list.commands;
+        commands.erase(std::remove_if(commands.begin(), commands.end(), [](const CommandList::Command& c) {
+            return c.type == CommandList::viewport || c.type == CommandList::fill ||
+                   c.type == CommandList::stroke || c.type == CommandList::triangles;
+        }), commands.end());
+    }
+
+    CommandList::Command& add_draw(CommandList::Type type, NVGpaint* paint, NVGcompositeOperationState composite, NVGscissor* scissor, float fringe) {
+        auto& command = add(type);
+        command.image = paint->image;
+        command.paint = *paint;
+        command.composite = composite;
+        command.scissor = *scissor;
+        command.fringe = fringe;
+        return command;
+    }
+
+    void add_paths(CommandList::Command& command, const NVGpath* paths, int count) {
+        command.first = list.paths.size();
+        command.count = count;
+
+        for (int i = 0; i < count; ++i) {
+            CommandList::Path p = { paths[i], list.vertices.size(), 0 };
+            list.vertices.insert(list.vertices.end(), paths[i].fill, paths[i].fill + paths[i].nfill);
+            p.stroke = list.vertices.size();
+            list.vertices.insert(list.vertices.end(), paths[i].stroke, paths[i].stroke + paths[i].nstroke);
+            list.paths.push_back(p);
+        }
+    }
+
+    static void render_fill(void* uptr, NVGpaint* paint, NVGcompositeOperationState composite, NVGscissor* scissor,
+                            float fringe, const float* bounds, const NVGpath* paths, int count) {
+        auto& r = get(uptr);
+        auto& command = r.add_draw(CommandList::fill, paint, composite, scissor, fringe);
+        std::memcpy(command.bounds, bounds, sizeof(command.bounds));
+        r.add_paths(command, paths, count);
+    }
+
+    static void render_stroke(void* uptr, NVGpaint* paint, NVGcompositeOperationState composite, NVGscissor* scissor,
+                              float fringe, float stroke_width, const NVGpath* paths, int count) {
+        auto& r = get(uptr);
+        auto& command = r.add_draw(CommandList::stroke, paint, composite, scissor, fringe);
+        command.stroke_width = stroke_width;
+        r.add_paths(command, paths, count);
+    }
+
+    static void render_triangles(void* uptr, NVGpaint* paint, NVGcompositeOperationState composite, NVGscissor* scissor,
+                                 const NVGvertex* verts, int count, float fringe) {
+        auto& r = get(uptr);
+        auto& command = r.add_draw(CommandList::triangles, paint, composite, scissor, fringe);
+        command.first = r.list.vertices.size();
+        command.count = count;
+        r.list.vertices.insert(r.list.vertices.end(), verts, verts + count);
+    }
+
+    CommandList list;
+    std::vector<Texture> textures;
+};
+
+
+/*
+    Owns the GL context and presents the CommandLists the update thread submits. There is
+    one list being recorded, one waiting and one being drawn, so the update thread only
+    waits when it gets a whole frame ahead of the GPU.
+*/
+class RenderThread {
+public:
+
+    typedef NVGcontext* (*CreateBackend)(int flags);
+    typedef void (*DeleteBackend)(NVGcontext* ctx);
+
+    RenderThread() { }
+
+    RenderThread(const RenderThread&) = delete;
+    void operator=(const RenderThread&) = delete;
+
+    ~RenderThread() {
+        stop();
+    }
+
+    // Called on the render thread right after a frame was presented, set it before start.
+    void set_present_callback(const std::function<void(const CommandList&)>& callback) {
+        on_present = callback;
+    }
+
+    // Takes `context` over from the calling thread, the backend is created on the render thread.
+    void start(SDL_Window* window, SDL_GLContext context, CreateBackend create, DeleteBackend destroy, int flags) {
+        SDL_GL_MakeCurrent(window, nullptr);
+
+        running = true;
+        thread = std::thread([=]() {
+            SDL_GL_MakeCurrent(window, context);
+            backend = create(flags);
+            run(window);
+            destroy(backend);
+            SDL_GL_MakeCurrent(window, nullptr);
+        });
+    }
+
+    // Finishes the frames already submitted, the GL context is current on no thread afterwards.
+    void stop() {
+        if (!thread.joinable()) {
+            return;
+        }
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            running = false;
+        }
+        wake.notify_all();
+        thread.join();
+    }
+
+    // Hands a finished frame over and gives back an empty list to record the next one into.
+    void submit(CommandList& list) {
+        std::unique_lock<std::mutex> lock(mutex);
+        done.wait(lock, [&]() { return !has_pending; });
+
+        std::swap(pending, list);
+        has_pending = true;
+        lock.unlock();
+
+        wake.notify_all();
+    }
+
+    // Runs `task` on the render thread with the GL context current, and waits for it.
+    void invoke(const std::function<void()>& task) {
+        if (!thread.joinable()) {
+            task();
+            return;
+        }
+
+        std::unique_lock<std::mutex> lock(mutex);
+        tasks.push_back(&task);
+        wake.notify_all();
+        done.wait(lock, [&]() { return std::find(tasks.begin(), tasks.end(), &task) == tasks.end(); });
+    }
+
+private:
+
+    void run(SDL_Window* window) {
+        std::unique_lock<std::mutex> lock(mutex);
+        for (;;) {
+            wake.wait(lock, [&]() { return has_pending || !tasks.empty() || !running; });
+
+            while (!tasks.empty()) {
+                (*tasks.front())();
+                tasks.erase(tasks.begin());
+            }
+
+            if (has_pending) {
+                std::swap(drawing, pending);
+                has_pending = false;
+                done.notify_all();
+
+                lock.unlock();
+                draw(window);
+                lock.lock();
+            } else if (!running) {
+                break;
+            }
+
+            done.notify_all();
+        }
+    }
+
+    void draw(SDL_Window* window) {
+        replay(drawing);
+
+        if (drawing.frame) {
+            SDL_GL_SwapWindow(window);
+            if (on_present) {
+                on_present(drawing);
+            }
+        }
+        drawing.clear();
+    }
+
+    int get_texture(int image) const {
+        return image > 0 && image <= (int)textures.size() ? textures[image - 1].id : 0;
+    }
+
+    void replay(CommandList& list) {
+        NVGparams* gl = nvgInternalParams(backend);
+
+        for (auto& c : list.commands) {
+            const unsigned char* data = c.data != CommandList::npos ? &list.bytes[c.data] : nullptr;
+            NVGpaint paint = c.paint;
+            paint.image = get_texture(c.image);
+
+            switch (c.type) {
+            case CommandList::create_texture:
+                if ((int)textures.size() < c.image) {
+                    textures.resize(c.image);
+                }
+                textures[c.image - 1] = {
+                    gl->renderCreateTexture(gl->userPtr, c.texture_type, c.width, c.height, c.flags, data),
+                    c.texture_type, c.width
+                };
+                break;
+
+            case CommandList::update_texture:
+                update_texture(gl, c, data);
+                break;
+
+            case CommandList::delete_texture:
+                gl->renderDeleteTexture(gl->userPtr, get_texture(c.image));
+                textures[c.image - 1].id = 0;
+                break;
+
+            case CommandList::viewport:
+                glViewport(0, 0, (GLsizei)(c.width * c.ratio), (GLsizei)(c.height * c.ratio));
+                glClearColor(list.clear_color.r, list.clear_color.g, list.clear_color.b, list.clear_color.a);
+                glClear(GL_COLOR_BUFFER_BIT);
+                gl->renderViewport(gl->userPtr, (float)c.width, (float)c.height, c.ratio);
+                break;
+
+            case CommandList::fill:
+                fix_paths(list, c);
+                gl->renderFill(gl->userPtr, &paint, c.composite, &c.scissor, c.fringe, c.bounds, paths.data(), (int)c.count);
+                break;
+
+            case CommandList::stroke:
+                fix_paths(list, c);
+                gl->renderStroke(gl->userPtr, &paint, c.composite, &c.scissor, c.fringe, c.stroke_width, paths.data(), (int)c.count);
+                break;
+
+            case CommandList::triangles:
+                gl->renderTriangles(gl->userPtr, &paint, c.composite, &c.scissor, list.vertices.data() + c.first, (int)c.count, c.fringe);
+                break;
+            }
+        }
+
+        if (list.frame) {
+            gl->renderFlush(gl->userPtr);
+        }
+    }
+
+    // Backends read the dirty rectangle out of a whole image, rebuild enough of one around the rows that were kept.
+    void update_texture(NVGparams* gl, const CommandList::Command& c, const unsigned char* rows) {
+        if (c.image < 1 || c.image > (int)textures.size()) {
+            return;
+        }
+
+        auto& texture = textures[c.image - 1];
+        std::size_t stride = (std::size_t)texture.width * (texture.type == NVG_TEXTURE_RGBA ? 4 : 1);
+
+        upload.resize((c.y + c.height) * stride);
+        std::memcpy(upload.data() + c.y * stride, rows, c.height * stride);
+        gl->renderUpdateTexture(gl->userPtr, texture.id, c.x, c.y, c.width, c.height, upload.data());
+    }
+
+    // Points the recorded paths back at their vertices.
+    void fix_paths(CommandList& list, const CommandList::Command& c) {
+        paths.resize(c.count);
+        for (std::size_t i = 0; i < c.count; ++i) {
+            auto& p = list.paths[c.first + i];
+            paths[i] = p.path;
+            paths[i].fill = list.vertices.data() + p.fill;
+            paths[i].stroke = list.vertices.data() + p.stroke;
+        }
+    }
+
+    std::thread thread;
+    std::mutex mutex;
+    std::condition_variable wake, done;
+
+    bool running = false;
+    bool has_pending = false;
+    CommandList pending, drawing;
+    std::vector<const std::function<void()>*> tasks;
+    std::function<void(const CommandList&)> on_present;
+
+    struct Texture {
+        int id = 0; // the backend's id
+        int type = 0, width = 0;
+    };
+
+    // Only touched on the render thread.
+    NVGcontext* backend = nullptr;
+    std::vector<Texture> textures; // indexed by recorder id - 1
+    std::vector<NVGpath> paths;
+    std::vector<unsigned char> upload;
+};
@@ -0,0 +1,1039 @@
+#pragma once
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include <nanovg.h>
+
+#include "canvas.hpp"
+#include "worker_pool.hpp"
+
+// AVX2 has to be enabled for the whole build (the SOFTWARE_RENDERER_AVX2 CMake option), SSE2 comes with every x86-64 target.
+#if defined(__AVX2__)
+#define SOFTWARE_AVX2
+#endif
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define SOFTWARE_SSE2
+#endif
+
+#if defined(SOFTWARE_AVX2)
+#include <immintrin.h>
+#elif defined(SOFTWARE_SSE2)
+#include <emmintrin.h>
+#endif
+
+/*
+    A nanovg backend that draws on the CPU into an RGBA buffer, so a Canvas works on machines
+    without a GPU or a display: thumbnails, exports, and benchmarks that compare pixels.
+
+    nanovg still flattens and strokes the paths, the renderer only rasterizes what it gets.
+    Coverage is the exact area of each pixel inside the shape, accumulated along scanlines, so
+    antialiasing needs none of nanovg's fringe geometry and overlapping parts of a path are
+    filled once. Draw calls are collected until the frame is flushed, then the target is cut
+    into tiles and every thread takes tiles and draws each call that touches them, in order.
+    Tiles don't depend on the thread count, so neither do the pixels. Builds with different
+    kernels (scalar, SSE2, AVX2) sum coverage in a different order and may be one off here and
+    there.
+
+    Only nanovg's default composite operation (premultiplied source over) is supported. The
+    buffer holds premultiplied colors, rows top down.
+*/
+class SoftwareRenderer {
+public:
+
+    static const int tile_size = 64;
+
+    // `threads` counts the caller, 0 uses every core.
+    explicit SoftwareRenderer(std::size_t threads = 0) : pool(threads), scratch(pool.get_threads()) { }
+
+    SoftwareRenderer(const SoftwareRenderer&) = delete;
+    void operator=(const SoftwareRenderer&) = delete;
+
+    ~SoftwareRenderer() {
+        destroy();
+    }
+
+    bool create(int width, int height) {
+        destroy();
+        resize(width, height);
+
+        NVGparams params;
+        std::memset(&params, 0, sizeof(params));
+        params.userPtr = this;
+        params.edgeAntiAlias = 0;
+        params.renderCreate = &render_create;
+        params.renderCreateTexture = &render_create_texture;
+        params.renderDeleteTexture = &render_delete_texture;
+        params.renderUpdateTexture = &render_update_texture;
+        params.renderGetTextureSize = &render_get_texture_size;
+        params.renderViewport = &render_viewport;
+        params.renderCancel = &render_cancel;
+        params.renderFlush = &render_flush;
+        params.renderFill = &render_fill;
+        params.renderStroke = &render_stroke;
+        params.renderTriangles = &render_triangles;
+        params.renderDelete = &render_delete;
+
+        NVGcontext* ctx = nvgCreateInternal(&params);
+        if (!ctx) {
+            printf("Error creating the software renderer\n");
+            return false;
+        }
+        canvas.set_context(ctx);
+        return true;
+    }
+
+    void destroy() {
+        NVGcontext* ctx = canvas.get_context();
+        if (ctx) {
+            canvas.set_context(nullptr);
+            nvgDeleteInternal(ctx);
+        }
+    }
+
+    void resize(int width, int height) {
+        size = { std::max(width, 1), std::max(height, 1) };
+        pixels.assign((std::size_t)size.x * size.y * 4, 0);
+    }
+
+    void set_threads(std::size_t threads) {
+        pool.set_threads(threads);
+        if (scratch.size() != pool.get_threads()) {
+            scratch.assign(pool.get_threads(), Scratch());
+        }
+    }
+
+    std::size_t get_threads() const {
+        return scratch.size();
+    }
+
+    void set_background(const Color& color) {
+        background = color;
+    }
+
+    // Clears the buffer to the background and starts a frame on the canvas.
+    void begin_frame() {
+        unsigned char clear[4] = { to_byte(background.r * background.a), to_byte(background.g * background.a),
+                                   to_byte(background.b * background.a), to_byte(background.a) };
+        for (std::size_t i = 0; i < pixels.size(); i += 4) {
+            std::memcpy(&pixels[i], clear, 4);
+        }
+        canvas.begin_frame(size);
+    }
+
+    // Draws everything the frame recorded, the pixels are ready when this returns.
+    void end_frame() {
+        canvas.end_frame();
+    }
+
+    Canvas& get_canvas() {
+        return canvas;
+    }
+
+    const glm::ivec2& get_size() const {
+        return size;
+    }
+
+    const std::vector<unsigned char>& get_pixels() const {
+        return pixels;
+    }
+
+    // Writes the last frame as a binary PPM, the same format as Window::save_frame.
+    bool save_frame(const std::string& filename) const {
+        std::ofstream out(filename, std::ios::binary);
+        if (!out) {
+            printf("Error saving frame to '%s'\n", filename.c_str());
+            return false;
+        }
+
+        out << "P6\n" << size.x << " " << size.y << "\n255\n";
+        for (std::size_t i = 0; i < pixels.size(); i += 4) {
+            out.write(reinterpret_cast<const char*>(&pixels[i]), 3);
+        }
+        return true;
+    }
+
+private:
+
+    static const int accumulate_stride = tile_size + 8;
+
+    struct Texture {
+        int width, height, type, flags;
+        std::vector<unsigned char> data;
+    };
+
+    enum class ShaderType { solid, gradient, image, glyphs };
+
+    // A converted NVGpaint and scissor, the same maths as nanovg's GL fragment shader.
+    struct Shader {
+        ShaderType type;
+        float inner[4], outer[4]; // premultiplied
+        float paint[6];           // canvas to paint space
+        float extent[2], radius, feather;
+        int image;
+
+        bool scissored;
+        float scissor[6];
+        float scissor_extent[2], scissor_scale[2];
+    };
+
+    // Edges of one coverage pass, `uv` maps pixels to texture coordinates for glyphs.
+    struct Shape {
+        std::size_t first, count;
+        int x0, y0, x1, y1;         // what can be seen of it
+        int ex0, ey0, ex1, ey1;     // where its edges are, the scissor can hide some of them
+        float uv[6];
+    };
+
+    struct Call {
+        Shader shader;
+        std::size_t first, count; // shapes
+        int x0, y0, x1, y1;
+    };
+
+    struct Edge {
+        float x0, y0, x1, y1;
+    };
+
+    // Per thread working memory for one tile.
+    struct Scratch {
+        Scratch() : accumulate(accumulate_stride * tile_size, 0.0f), coverage(accumulate_stride), colors(tile_size * 4),
+                    tile(tile_size * tile_size * 4) { }
+
+        std::vector<float> accumulate, coverage, colors, tile;
+    };
+
+
+    // nanovg callbacks
+
+    static SoftwareRenderer* get(void* user) {
+        return static_cast<SoftwareRenderer*>(user);
+    }
+
+    static int render_create(void*) {
+        return 1;
+    }
+
+    static int render_create_texture(void* user, int type, int w, int h, int flags, const unsigned char* data) {
+        SoftwareRenderer* self = get(user);
+        int id = self->next_texture++;
+
+        Texture& texture = self->textures[id];
+        texture.width = w;
+        texture.height = h;
+        texture.type = type;
+        texture.flags = flags;
+        texture.data.assign((std::size_t)w * h * (type == NVG_TEXTURE_RGBA ? 4 : 1), 0);
+        if (data) {
+            std::memcpy(texture.data.data(), data, texture.data.size());
+        }
+        return id;
+    }
+
+    static int render_delete_texture(void* user, int image) {
+        return get(user)->textures.erase(image) ? 1 : 0;
+    }
+
+    static int render_update_texture(void* user, int image, int x, int y, int w, int h, const unsigned char* data) {
+        Texture* texture = get(user)->find_texture(image);
+        if (!texture) {
+            return 0;
+        }
+
+        // `data` is the whole image, like glTexSubImage2D with GL_UNPACK_ROW_LENGTH set.
+        int bpp = texture->type == NVG_TEXTURE_RGBA ? 4 : 1;
+        for (int row = y; row < y + h; ++row) {
+            std::size_t offset = ((std::size_t)row * texture->width + x) * bpp;
+            std::memcpy(&texture->data[offset], data + offset, (std::size_t)w * bpp);
+        }
+        return 1;
+    }
+
+    static int render_get_texture_size(void* user, int image, int* w, int* h) {
+        Texture* texture = get(user)->find_texture(image);
+        if (!texture) {
+            return 0;
+        }
+        *w = texture->width;
+        *h = texture->height;
+        return 1;
+    }
+
+    static void render_viewport(void* user, float, float, float pixel_ratio) {
+        get(user)->pixel_ratio = pixel_ratio;
+    }
+
+    static void render_cancel(void* user) {
+        get(user)->reset();
+    }
+
+    static void render_flush(void* user) {
+        get(user)->flush();
+    }
+
+    static void render_fill(void* user, NVGpaint* paint, NVGcompositeOperationState, NVGscissor* scissor, float fringe,
+                            const float*, const NVGpath* paths, int npaths) {
+        SoftwareRenderer* self = get(user);
+        self->begin_call(*paint, *scissor, fringe);
+        self->begin_shape();
+        for (int i = 0; i < npaths; ++i) {
+            const NVGvertex* v = paths[i].fill;
+            int n = paths[i].nfill;
+            for (int j = 0, k = n - 1; j < n; k = j++) {
+                self->add_edge(v[k].x, v[k].y, v[j].x, v[j].y);
+            }
+        }
+        self->end_shape();
+        self->end_call();
+    }
+
+    static void render_stroke(void* user, NVGpaint* paint, NVGcompositeOperationState, NVGscissor* scissor, float fringe,
+                              float, const NVGpath* paths, int npaths) {
+        SoftwareRenderer* self = get(user);
+        self->begin_call(*paint, *scissor, fringe);
+        self->begin_shape();
+        for (int i = 0; i < npaths; ++i) {
+            const NVGvertex* v = paths[i].stroke;
+            for (int j = 0; j + 2 < paths[i].nstroke; ++j) {
+                self->add_triangle(v[j], v[j + 1], v[j + 2]);
+            }
+        }
+        self->end_shape();
+        self->end_call();
+    }
+
+    // Text, each glyph is a quad of two triangles with coordinates into the font atlas.
+    static void render_triangles(void* user, NVGpaint* paint, NVGcompositeOperationState, NVGscissor* scissor,
+                                 const NVGvertex* verts, int nverts, float fringe) {
+        SoftwareRenderer* self = get(user);
+        self->begin_call(*paint, *scissor, fringe);
+
+        Shader& shader = self->calls.back().shader;
+        Texture* texture = self->find_texture(paint->image);
+        if (texture) {
+            shader.type = ShaderType::glyphs;
+        }
+        // Triangles sharing a texture mapping (the two halves of a glyph) are covered together so the seam isn't blended twice.
+        float tolerance = texture ? 0.01f / std::max(texture->width, texture->height) : 0.0f;
+
+        bool open = false;
+        for (int i = 0; i + 2 < nverts; i += 3) {
+            const NVGvertex* v = verts + i;
+            float uv[6];
+            if (!self->texture_mapping(v, uv)) {
+                continue;
+            }
+
+            if (open && !self->fits_mapping(self->shapes.back().uv, v, tolerance)) {
+                self->end_shape();
+                open = false;
+            }
+            if (!open) {
+                self->begin_shape();
+                std::memcpy(self->shapes.back().uv, uv, sizeof(uv));
+                open = true;
+            }
+            self->add_triangle(v[0], v[1], v[2]);
+        }
+        if (open) {
+            self->end_shape();
+        }
+        self->end_call();
+    }
+
+    static void render_delete(void* user) {
+        SoftwareRenderer* self = get(user);
+        self->reset();
+        self->textures.clear();
+    }
+
+
+    // Recording
+
+    Texture* find_texture(int image) {
+        auto it = textures.find(image);
+        return it == textures.end() ? nullptr : &it->second;
+    }
+
+    void reset() {
+        calls.clear();
+        shapes.clear();
+        edges.clear();
+    }
+
+    void begin_call(const NVGpaint& paint, const NVGscissor& scissor, float fringe) {
+        Call call;
+        call.first = shapes.size();
+        call.count = 0;
+        call.x0 = call.y0 = 0;
+        call.x1 = call.y1 = 0;
+
+        Shader& s = call.shader;
+        premultiply(paint.innerColor, s.inner);
+        premultiply(paint.outerColor, s.outer);
+        nvgTransformInverse(s.paint, paint.xform);
+        s.extent[0] = paint.extent[0];
+        s.extent[1] = paint.extent[1];
+        s.radius = paint.radius;
+        s.feather = paint.feather;
+        s.image = paint.image;
+
+        if (find_texture(paint.image)) {
+            s.type = ShaderType::image;
+        } else if (std::memcmp(s.inner, s.outer, sizeof(s.inner)) == 0) {
+            s.type = ShaderType::solid;
+        } else {
+            s.type = ShaderType::gradient;
+        }
+
+        // nanovg marks a missing scissor with a negative extent.
+        s.scissored = scissor.extent[0] > -0.5f;
+        clip = { 0, 0, size.x, size.y };
+        if (s.scissored) {
+            const float* m = scissor.xform;
+            nvgTransformInverse(s.scissor, m);
+            s.scissor_extent[0] = scissor.extent[0];
+            s.scissor_extent[1] = scissor.extent[1];
+            s.scissor_scale[0] = std::sqrt(m[0] * m[0] + m[2] * m[2]) / fringe;
+            s.scissor_scale[1] = std::sqrt(m[1] * m[1] + m[3] * m[3]) / fringe;
+
+            // Nothing outside the scissor's bounding box needs visiting.
+            float ex = scissor.extent[0], ey = scissor.extent[1];
+            float hx = std::abs(m[0] * ex) + std::abs(m[2] * ey), hy = std::abs(m[1] * ex) + std::abs(m[3] * ey);
+            clip.x = std::max(clip.x, (int)std::floor((m[4] - hx) * pixel_ratio));
+            clip.y = std::max(clip.y, (int)std::floor((m[5] - hy) * pixel_ratio));
+            clip.z = std::min(clip.z, (int)std::ceil((m[4] + hx) * pixel_ratio) + 1);
+            clip.w = std::min(clip.w, (int)std::ceil((m[5] + hy) * pixel_ratio) + 1);
+        }
+
+        calls.push_back(call);
+    }
+
+    void end_call() {
+        Call& call = calls.back();
+        call.count = shapes.size() - call.first;
+        if (!call.count) {
+            calls.pop_back();
+            return;
+        }
+
+        call.x0 = call.y0 = INT32_MAX;
+        call.x1 = call.y1 = INT32_MIN;
+        for (std::size_t i = call.first; i < shapes.size(); ++i) {
+            call.x0 = std::min(call.x0, shapes[i].x0);
+            call.y0 = std::min(call.y0, shapes[i].y0);
+            call.x1 = std::max(call.x1, shapes[i].x1);
+            call.y1 = std::max(call.y1, shapes[i].y1);
+        }
+    }
+
+    void begin_shape() {
+        Shape shape;
+        shape.first = edges.size();
+        shape.count = 0;
+        std::memset(shape.uv, 0, sizeof(shape.uv));
+        shapes.push_back(shape);
+
+        bounds_min = { INFINITY, INFINITY };
+        bounds_max = { -INFINITY, -INFINITY };
+    }
+
+    // Drops shapes that are empty or fall outside the target or the scissor.
+    void end_shape() {
+        Shape& shape = shapes.back();
+        shape.count = edges.size() - shape.first;
+        if (shape.count) {
+            shape.ex0 = (int)std::floor(std::max(bounds_min.x, -1.0f));
+            shape.ey0 = (int)std::floor(std::max(bounds_min.y, -1.0f));
+            shape.ex1 = (int)std::ceil(std::min(bounds_max.x, size.x + 1.0f));
+            shape.ey1 = (int)std::ceil(std::min(bounds_max.y, size.y + 1.0f));
+            shape.x0 = std::max(clip.x, shape.ex0);
+            shape.y0 = std::max(clip.y, shape.ey0);
+            shape.x1 = std::min(clip.z, shape.ex1);
+            shape.y1 = std::min(clip.w, shape.ey1);
+        }
+
+        if (!shape.count || shape.x0 >= shape.x1 || shape.y0 >= shape.y1) {
+            edges.resize(shape.first);
+            shapes.pop_back();
+        }
+    }
+
+    // In canvas units, stored in pixels.
+    void add_edge(float x0, float y0, float x1, float y1) {
+        x0 *= pixel_ratio;
+        y0 *= pixel_ratio;
+        x1 *= pixel_ratio;
+        y1 *= pixel_ratio;
+        if (y0 == y1) {
+            return;
+        }
+
+        bounds_min = glm::min(bounds_min, glm::min(glm::vec2(x0, y0), glm::vec2(x1, y1)));
+        bounds_max = glm::max(bounds_max, glm::max(glm::vec2(x0, y0), glm::vec2(x1, y1)));
+        edges.push_back({ x0, y0, x1, y1 });
+    }
+
+    // Every triangle is added with the same orientation, so overlaps add up and shared edges cancel.
+    void add_triangle(const NVGvertex& a, const NVGvertex& b, const NVGvertex& c) {
+        float cross = (b.x - a.x) * (c.y - a.y) - (c.x - a.x) * (b.y - a.y);
+        if (cross == 0.0f) {
+            return;
+        }
+        const NVGvertex& p = cross > 0.0f ? b : c;
+        const NVGvertex& q = cross > 0.0f ? c : b;
+        add_edge(a.x, a.y, p.x, p.y);
+        add_edge(p.x, p.y, q.x, q.y);
+        add_edge(q.x, q.y, a.x, a.y);
+    }
+
+    // The affine map from pixel coordinates to the triangle's texture coordinates, as u = uv[0..2], v = uv[3..5].
+    bool texture_mapping(const NVGvertex* v, float* uv) const {
+        float x1 = (v[1].x - v[0].x) * pixel_ratio, y1 = (v[1].y - v[0].y) * pixel_ratio;
+        float x2 = (v[2].x - v[0].x) * pixel_ratio, y2 = (v[2].y - v[0].y) * pixel_ratio;
+        float det = x1 * y2 - x2 * y1;
+        if (det == 0.0f) {
+            return false;
+        }
+
+        float u1 = v[1].u - v[0].u, u2 = v[2].u - v[0].u;
+        float w1 = v[1].v - v[0].v, w2 = v[2].v - v[0].v;
+        float px = v[0].x * pixel_ratio, py = v[0].y * pixel_ratio;
+
+        uv[0] = (u1 * y2 - u2 * y1) / det;
+        uv[1] = (u2 * x1 - u1 * x2) / det;
+        uv[2] = v[0].u - uv[0] * px - uv[1] * py;
+        uv[3] = (w1 * y2 - w2 * y1) / det;
+        uv[4] = (w2 * x1 - w1 * x2) / det;
+        uv[5] = v[0].v - uv[3] * px - uv[4] * py;
+        return true;
+    }
+
+    bool fits_mapping(const float* uv, const NVGvertex* v, float tolerance) const {
+        for (int i = 0; i < 3; ++i) {
+            float x = v[i].x * pixel_ratio, y = v[i].y * pixel_ratio;
+            if (std::abs(uv[0] * x + uv[1] * y + uv[2] - v[i].u) > tolerance ||
+                std::abs(uv[3] * x + uv[4] * y + uv[5] - v[i].v) > tolerance) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+
+    // Rasterizing
+
+    void flush() {
+        if (!calls.empty()) {
+            tiles = { (size.x + tile_size - 1) / tile_size, (size.y + tile_size - 1) / tile_size };
+            next = 0;
+            pool.run([this](std::size_t thread) {
+                std::size_t count = (std::size_t)tiles.x * tiles.y;
+                for (std::size_t i = next++; i < count; i = next++) {
+                    draw_tile((int)i, scratch[thread]);
+                }
+            });
+        }
+        reset();
+    }
+
+    void draw_tile(int index, Scratch& s) {
+        int tx = (index % tiles.x) * tile_size, ty = (index / tiles.x) * tile_size;
+        int tw = std::min((int)tile_size, size.x - tx), th = std::min((int)tile_size, size.y - ty);
+
+        bool loaded = false;
+        for (auto& call : calls) {
+            if (call.x1 <= tx || call.x0 >= tx + tw || call.y1 <= ty || call.y0 >= ty + th) {
+                continue;
+            }
+            if (!loaded) {
+                load_tile(s.tile.data(), tx, ty, tw, th);
+                loaded = true;
+            }
+
+            for (std::size_t i = call.first; i < call.first + call.count; ++i) {
+                draw_shape(call.shader, shapes[i], s, tx, ty, tw, th);
+            }
+        }
+
+        if (loaded) {
+            store_tile(s.tile.data(), tx, ty, tw, th);
+        }
+    }
+
+    void draw_shape(const Shader& shader, const Shape& shape, Scratch& s, int tx, int ty, int tw, int th) {
+        int x0 = std::max(shape.x0 - tx, 0), x1 = std::min(shape.x1 - tx, tw);
+        int y0 = std::max(shape.y0 - ty, 0), y1 = std::min(shape.y1 - ty, th);
+        if (x0 >= x1 || y0 >= y1) {
+            return;
+        }
+
+        float* accumulate = s.accumulate.data();
+        for (std::size_t i = shape.first; i < shape.first + shape.count; ++i) {
+            const Edge& e = edges[i];
+            add_line(accumulate, tw, th, e.x0 - tx, e.y0 - ty, e.x1 - tx, e.y1 - ty);
+        }
+
+        // Every cell the edges wrote to is summed and cleared, even where the scissor hides the shape.
+        // Lines write at most two cells past the shape, the kernels want multiples of 8.
+        int ey0 = std::max(shape.ey0 - ty, 0), ey1 = std::min(shape.ey1 - ty, th);
+        int a0 = std::max(shape.ex0 - tx, 0) & ~7;
+        int a1 = std::min((std::min(shape.ex1 - tx, tw) + 2 + 7) & ~7, (int)accumulate_stride);
+        for (int y = ey0; y < ey1; ++y) {
+            float* coverage = s.coverage.data();
+            accumulate_row(accumulate + y * accumulate_stride + a0, coverage + a0, a1 - a0);
+            if (y < y0 || y >= y1) {
+                continue;
+            }
+
+            float py = (ty + y + 0.5f) / pixel_ratio;
+            if (shader.scissored) {
+                for (int x = x0; x < x1; ++x) {
+                    if (coverage[x] > 0.0f) {
+                        coverage[x] *= scissor_mask(shader, (tx + x + 0.5f) / pixel_ratio, py);
+                    }
+                }
+            }
+
+            float* dst = s.tile.data() + (y * tile_size + x0) * 4;
+            if (shader.type == ShaderType::solid) {
+                blend_solid(dst, coverage + x0, shader.inner, x1 - x0);
+            } else {
+                shade(shader, shape, s.colors.data(), coverage + x0, tx + x0, ty + y, x1 - x0);
+                blend_colors(dst, coverage + x0, s.colors.data(), x1 - x0);
+            }
+        }
+    }
+
+    // Paint colors for `n` pixels from (x, y) on, pixels without coverage are skipped.
+    void shade(const Shader& shader, const Shape& shape, float* colors, const float* coverage, int x, int y, int n) const {
+        const Texture* texture = shader.type == ShaderType::image || shader.type == ShaderType::glyphs ?
+                                 &textures.at(shader.image) : nullptr;
+
+        float py = y + 0.5f;
+        for (int i = 0; i < n; ++i, colors += 4) {
+            if (coverage[i] <= 0.0f) {
+                continue;
+            }
+
+            float px = x + i + 0.5f;
+            float cx = px / pixel_ratio, cy = py / pixel_ratio;
+            const float* m = shader.paint;
+            float u = m[0] * cx + m[2] * cy + m[4];
+            float v = m[1] * cx + m[3] * cy + m[5];
+
+            switch (shader.type) {
+            case ShaderType::solid:
+                std::memcpy(colors, shader.inner, sizeof(shader.inner));
+                break;
+
+            case ShaderType::gradient: {
+                float d = (round_rect_distance(u, v, shader.extent[0], shader.extent[1], shader.radius) + shader.feather * 0.5f) / shader.feather;
+                d = std::min(std::max(d, 0.0f), 1.0f);
+                for (int c = 0; c < 4; ++c) {
+                    colors[c] = shader.inner[c] + (shader.outer[c] - shader.inner[c]) * d;
+                }
+                break;
+            }
+
+            case ShaderType::image:
+                sample(*texture, u / shader.extent[0], v / shader.extent[1], colors);
+                for (int c = 0; c < 4; ++c) {
+                    colors[c] *= shader.inner[c];
+                }
+                break;
+
+            case ShaderType::glyphs:
+                sample(*texture, shape.uv[0] * px + shape.uv[1] * py + shape.uv[2], shape.uv[3] * px + shape.uv[4] * py + shape.uv[5], colors);
+                for (int c = 0; c < 4; ++c) {
+                    colors[c] *= shader.inner[c];
+                }
+                break;
+            }
+        }
+    }
+
+    // Bilinear, or nearest with NVG_IMAGE_NEAREST, premultiplied like the GL backend's shader.
+    static void sample(const Texture& t, float u, float v, float* out) {
+        if (t.flags & NVG_IMAGE_FLIPY) {
+            v = 1.0f - v;
+        }
+
+        auto wrap = [](int i, int size, bool repeat) {
+            if (repeat) {
+                i %= size;
+                return i < 0 ? i + size : i;
+            }
+            return std::min(std::max(i, 0), size - 1);
+        };
+        bool repeat_x = (t.flags & NVG_IMAGE_REPEATX) != 0, repeat_y = (t.flags & NVG_IMAGE_REPEATY) != 0;
+        int bpp = t.type == NVG_TEXTURE_RGBA ? 4 : 1;
+
+        float texel[4] = { 0.0f, 0.0f, 0.0f, 0.0f };
+        auto add = [&](int x, int y, float weight) {
+            const unsigned char* p = &t.data[((std::size_t)wrap(y, t.height, repeat_y) * t.width + wrap(x, t.width, repeat_x)) * bpp];
+            for (int c = 0; c < bpp; ++c) {
+                texel[c] += p[c] * weight;
+            }
+        };
+
+        if (t.flags & NVG_IMAGE_NEAREST) {
+            add((int)std::floor(u * t.width), (int)std::floor(v * t.height), 1.0f);
+        } else {
+            float x = u * t.width - 0.5f, y = v * t.height - 0.5f;
+            float fx = std::floor(x), fy = std::floor(y);
+            int ix = (int)fx, iy = (int)fy;
+            float ax = x - fx, ay = y - fy;
+            add(ix, iy, (1.0f - ax) * (1.0f - ay));
+            add(ix + 1, iy, ax * (1.0f - ay));
+            add(ix, iy + 1, (1.0f - ax) * ay);
+            add(ix + 1, iy + 1, ax * ay);
+        }
+
+        if (bpp == 1) {
+            // Font atlases, coverage only.
+            float a = texel[0] / 255.0f;
+            out[0] = out[1] = out[2] = out[3] = a;
+            return;
+        }
+
+        for (int c = 0; c < 4; ++c) {
+            out[c] = texel[c] / 255.0f;
+        }
+        if (!(t.flags & NVG_IMAGE_PREMULTIPLIED)) {
+            out[0] *= out[3];
+            out[1] *= out[3];
+            out[2] *= out[3];
+        }
+    }
+
+    static float round_rect_distance(float x, float y, float ex, float ey, float r) {
+        float dx = std::abs(x) - (ex - r), dy = std::abs(y) - (ey - r);
+        float outside = std::sqrt(std::max(dx, 0.0f) * std::max(dx, 0.0f) + std::max(dy, 0.0f) * std::max(dy, 0.0f));
+        return std::min(std::max(dx, dy), 0.0f) + outside - r;
+    }
+
+    static float scissor_mask(const Shader& s, float x, float y) {
+        const float* m = s.scissor;
+        float sx = std::abs(m[0] * x + m[2] * y + m[4]) - s.scissor_extent[0];
+        float sy = std::abs(m[1] * x + m[3] * y + m[5]) - s.scissor_extent[1];
+        sx = std::min(std::max(0.5f - sx * s.scissor_scale[0], 0.0f), 1.0f);
+        sy = std::min(std::max(0.5f - sy * s.scissor_scale[1], 0.0f), 1.0f);
+        return sx * sy;
+    }
+
+    static void premultiply(const NVGcolor& c, float* out) {
+        out[0] = c.r * c.a;
+        out[1] = c.g * c.a;
+        out[2] = c.b * c.a;
+        out[3] = c.a;
+    }
+
+    static unsigned char to_byte(float v) {
+        return (unsigned char)std::lrint(std::min(std::max(v, 0.0f), 1.0f) * 255.0f);
+    }
+
+
+    /*
+        Clips a line to a `w` x `h` tile before accumulating it. Rows outside the tile are cut
+        off. Anything left of the tile still covers all of it, so that part is moved onto the
+        left edge, and anything right of the tile can't reach it, so it is moved onto the right
+        edge where it only touches cells no pixel reads.
+    */
+    static void add_line(float* accumulate, int w, int h, float x0, float y0, float x1, float y1) {
+        if (y0 == y1 || (y0 <= 0.0f && y1 <= 0.0f) || (y0 >= h && y1 >= h) || (x0 >= w && x1 >= w)) {
+            return;
+        }
+
+        float dxdy = (x1 - x0) / (y1 - y0);
+        auto clip_y = [&](float& x, float& y, float limit) {
+            x += (limit - y) * dxdy;
+            y = limit;
+        };
+        if (y0 < 0.0f) clip_y(x0, y0, 0.0f);
+        if (y1 < 0.0f) clip_y(x1, y1, 0.0f);
+        if (y0 > h) clip_y(x0, y0, (float)h);
+        if (y1 > h) clip_y(x1, y1, (float)h);
+
+        // Split where the line crosses either side of the tile.
+        float t[4] = { 0.0f, 0.0f, 0.0f, 1.0f };
+        int splits = 1;
+        for (float edge : { 0.0f, (float)w }) {
+            if ((x0 < edge) != (x1 < edge)) {
+                t[splits++] = (edge - x0) / (x1 - x0);
+            }
+        }
+        t[splits] = 1.0f;
+        std::sort(t + 1, t + splits);
+
+        for (int i = 0; i < splits; ++i) {
+            float xa = x0 + (x1 - x0) * t[i], ya = y0 + (y1 - y0) * t[i];
+            float xb = x0 + (x1 - x0) * t[i + 1], yb = y0 + (y1 - y0) * t[i + 1];
+            float mid = 0.5f * (xa + xb);
+            if (mid < 0.0f) {
+                xa = xb = 0.0f;
+            } else if (mid > w) {
+                xa = xb = (float)w;
+            }
+            draw_line(accumulate, h, std::min(std::max(xa, 0.0f), (float)w), ya, std::min(std::max(xb, 0.0f), (float)w), yb);
+        }
+    }
+
+    /*
+        Adds the signed area a line covers to the cells of every row it crosses, a running sum
+        along a row then gives each pixel's coverage. Positive going down, so holes wound the
+        other way cancel out.
+    */
+    static void draw_line(float* accumulate, int rows, float x0, float y0, float x1, float y1) {
+        if (y0 == y1) {
+            return;
+        }
+
+        float dir = 1.0f;
+        if (y0 > y1) {
+            std::swap(x0, x1);
+            std::swap(y0, y1);
+            dir = -1.0f;
+        }
+
+        float dxdy = (x1 - x0) / (y1 - y0);
+        float x = x0;
+        float x_min = std::min(x0, x1), x_max = std::max(x0, x1);
+        int end = std::min(rows, (int)std::ceil(y1));
+        for (int y = (int)y0; y < end; ++y) {
+            float* row = accumulate + y * accumulate_stride;
+            float dy = std::min((float)(y + 1), y1) - std::max((float)y, y0);
+            // Steep slopes add up rounding errors, the line must not drift out of the tile.
+            float x_next = std::min(std::max(x + dxdy * dy, x_min), x_max);
+            float d = dy * dir;
+
+            float xa = std::min(x, x_next), xb = std::max(x, x_next);
+            float xa_floor = std::floor(xa), xb_ceil = std::ceil(xb);
+            int ia = (int)xa_floor, ib = (int)xb_ceil;
+
+            if (ib <= ia + 1) {
+                // Within one pixel, split by where the line crosses it on average.
+                float mid = 0.5f * (x + x_next) - xa_floor;
+                row[ia] += d - d * mid;
+                row[ia + 1] += d * mid;
+            } else {
+                float s = 1.0f / (xb - xa);
+                float fa = xa - xa_floor;
+                float first = 0.5f * s * (1.0f - fa) * (1.0f - fa);
+                float fb = xb - xb_ceil + 1.0f;
+                float last = 0.5f * s * fb * fb;
+
+                row[ia] += d * first;
+                if (ib == ia + 2) {
+                    row[ia + 1] += d * (1.0f - first - last);
+                } else {
+                    float second = s * (1.5f - fa);
+                    row[ia + 1] += d * (second - first);
+                    for (int i = ia + 2; i < ib - 1; ++i) {
+                        row[i] += d * s;
+                    }
+                    float before_last = second + (ib - ia - 3) * s;
+                    row[ib - 1] += d * (1.0f - before_last - last);
+                }
+                row[ib] += d * last;
+            }
+            x = x_next;
+        }
+    }
+
+
+    // Kernels
+
+    // Running sum of `n` cells (a multiple of 8) into coverage, clearing the cells for the next shape.
+    static void accumulate_row(float* cells, float* coverage, int n) {
+        int i = 0;
+#if defined(SOFTWARE_AVX2)
+        __m256 sum8 = _mm256_setzero_ps();
+        __m256 sign8 = _mm256_set1_ps(-0.0f), one8 = _mm256_set1_ps(1.0f);
+        for (; i + 8 <= n; i += 8) {
+            __m256 v = _mm256_loadu_ps(cells + i);
+            v = _mm256_add_ps(v, _mm256_castsi256_ps(_mm256_slli_si256(_mm256_castps_si256(v), 4)));
+            v = _mm256_add_ps(v, _mm256_castsi256_ps(_mm256_slli_si256(_mm256_castps_si256(v), 8)));
+            // Carry the low half's total into the high half.
+            __m256 carry = _mm256_permute2f128_ps(v, v, 0x08);
+            v = _mm256_add_ps(v, _mm256_shuffle_ps(carry, carry, _MM_SHUFFLE(3, 3, 3, 3)));
+            v = _mm256_add_ps(v, sum8);
+
+            __m256 high = _mm256_permute2f128_ps(v, v, 0x11);
+            sum8 = _mm256_shuffle_ps(high, high, _MM_SHUFFLE(3, 3, 3, 3));
+            _mm256_storeu_ps(coverage + i, _mm256_min_ps(_mm256_andnot_ps(sign8, v), one8));
+            _mm256_storeu_ps(cells + i, _mm256_setzero_ps());
+        }
+        float sum = _mm256_cvtss_f32(sum8);
+#else
+        float sum = 0.0f;
+#endif
+
+#if defined(SOFTWARE_SSE2)
+        __m128 sum4 = _mm_set1_ps(sum);
+        __m128 sign4 = _mm_set1_ps(-0.0f), one4 = _mm_set1_ps(1.0f);
+        for (; i + 4 <= n; i += 4) {
+            __m128 v = _mm_loadu_ps(cells + i);
+            v = _mm_add_ps(v, _mm_castsi128_ps(_mm_slli_si128(_mm_castps_si128(v), 4)));
+            v = _mm_add_ps(v, _mm_castsi128_ps(_mm_slli_si128(_mm_castps_si128(v), 8)));
+            v = _mm_add_ps(v, sum4);
+            sum4 = _mm_shuffle_ps(v, v, _MM_SHUFFLE(3, 3, 3, 3));
+            _mm_storeu_ps(coverage + i, _mm_min_ps(_mm_andnot_ps(sign4, v), one4));
+            _mm_storeu_ps(cells + i, _mm_setzero_ps());
+        }
+        sum = _mm_cvtss_f32(sum4);
+#endif
+
+        for (; i < n; ++i) {
+            sum += cells[i];
+            cells[i] = 0.0f;
+            coverage[i] = std::min(std::abs(sum), 1.0f);
+        }
+    }
+
+    // Source over with one premultiplied color, `dst` is premultiplied RGBA floats.
+    static void blend_solid(float* dst, const float* coverage, const float* color, int n) {
+        int i = 0;
+#if defined(SOFTWARE_AVX2)
+        __m128 c4 = _mm_loadu_ps(color);
+        __m256 c8 = _mm256_insertf128_ps(_mm256_castps128_ps256(c4), c4, 1);
+        __m256 one8 = _mm256_set1_ps(1.0f);
+        for (; i + 2 <= n; i += 2) {
+            __m256 k = _mm256_insertf128_ps(_mm256_castps128_ps256(_mm_set1_ps(coverage[i])), _mm_set1_ps(coverage[i + 1]), 1);
+            __m256 s = _mm256_mul_ps(c8, k);
+            __m256 a = _mm256_shuffle_ps(s, s, _MM_SHUFFLE(3, 3, 3, 3));
+            __m256 d = _mm256_loadu_ps(dst + i * 4);
+            _mm256_storeu_ps(dst + i * 4, _mm256_add_ps(s, _mm256_mul_ps(d, _mm256_sub_ps(one8, a))));
+        }
+#endif
+
+#if defined(SOFTWARE_SSE2)
+        __m128 c = _mm_loadu_ps(color);
+        __m128 one = _mm_set1_ps(1.0f);
+        for (; i < n; ++i) {
+            __m128 s = _mm_mul_ps(c, _mm_set1_ps(coverage[i]));
+            __m128 a = _mm_shuffle_ps(s, s, _MM_SHUFFLE(3, 3, 3, 3));
+            __m128 d = _mm_loadu_ps(dst + i * 4);
+            _mm_storeu_ps(dst + i * 4, _mm_add_ps(s, _mm_mul_ps(d, _mm_sub_ps(one, a))));
+        }
+#else
+        for (; i < n; ++i) {
+            float* d = dst + i * 4;
+            float a = color[3] * coverage[i];
+            for (int c = 0; c < 4; ++c) {
+                d[c] = color[c] * coverage[i] + d[c] * (1.0f - a);
+            }
+        }
+#endif
+    }
+
+    // Source over with a premultiplied color per pixel.
+    static void blend_colors(float* dst, const float* coverage, const float* colors, int n) {
+        int i = 0;
+#if defined(SOFTWARE_AVX2)
+        __m256 one8 = _mm256_set1_ps(1.0f);
+        for (; i + 2 <= n; i += 2) {
+            __m256 k = _mm256_insertf128_ps(_mm256_castps128_ps256(_mm_set1_ps(coverage[i])), _mm_set1_ps(coverage[i + 1]), 1);
+            __m256 s = _mm256_mul_ps(_mm256_loadu_ps(colors + i * 4), k);
+            __m256 a = _mm256_shuffle_ps(s, s, _MM_SHUFFLE(3, 3, 3, 3));
+            __m256 d = _mm256_loadu_ps(dst + i * 4);
+            _mm256_storeu_ps(dst + i * 4, _mm256_add_ps(s, _mm256_mul_ps(d, _mm256_sub_ps(one8, a))));
+        }
+#endif
+
+#if defined(SOFTWARE_SSE2)
+        __m128 one = _mm_set1_ps(1.0f);
+        for (; i < n; ++i) {
+            __m128 s = _mm_mul_ps(_mm_loadu_ps(colors + i * 4), _mm_set1_ps(coverage[i]));
+            __m128 a = _mm_shuffle_ps(s, s, _MM_SHUFFLE(3, 3, 3, 3));
+            __m128 d = _mm_loadu_ps(dst + i * 4);
+            _mm_storeu_ps(dst + i * 4, _mm_add_ps(s, _mm_mul_ps(d, _mm_sub_ps(one, a))));
+        }
+#else
+        for (; i < n; ++i) {
+            float* d = dst + i * 4;
+            const float* color = colors + i * 4;
+            float a = color[3] * coverage[i];
+            for (int c = 0; c < 4; ++c) {
+                d[c] = color[c] * coverage[i] + d[c] * (1.0f - a);
+            }
+        }
+#endif
+    }
+
+    // Bytes to floats in [0, 1], a row of the tile at a time.
+    void load_tile(float* tile, int tx, int ty, int tw, int th) const {
+        for (int y = 0; y < th; ++y) {
+            const unsigned char* src = &pixels[((std::size_t)(ty + y) * size.x + tx) * 4];
+            float* dst = tile + y * tile_size * 4;
+            int i = 0;
+#if defined(SOFTWARE_SSE2)
+            __m128i zero = _mm_setzero_si128();
+            __m128 scale = _mm_set1_ps(1.0f / 255.0f);
+            for (; i + 4 <= tw * 4; i += 4) {
+                int packed;
+                std::memcpy(&packed, src + i, 4);
+                __m128i v = _mm_unpacklo_epi16(_mm_unpacklo_epi8(_mm_cvtsi32_si128(packed), zero), zero);
+                _mm_storeu_ps(dst + i, _mm_mul_ps(_mm_cvtepi32_ps(v), scale));
+            }
+#endif
+            for (; i < tw * 4; ++i) {
+                dst[i] = src[i] * (1.0f / 255.0f);
+            }
+        }
+    }
+
+    void store_tile(const float* tile, int tx, int ty, int tw, int th) {
+        for (int y = 0; y < th; ++y) {
+            const float* src = tile + y * tile_size * 4;
+            unsigned char* dst = &pixels[((std::size_t)(ty + y) * size.x + tx) * 4];
+            int i = 0;
+#if defined(SOFTWARE_SSE2)
+            __m128 scale = _mm_set1_ps(255.0f);
+            __m128 zero = _mm_setzero_ps(), one = _mm_set1_ps(1.0f);
+            for (; i + 4 <= tw * 4; i += 4) {
+                __m128 v = _mm_min_ps(_mm_max_ps(_mm_loadu_ps(src + i), zero), one);
+                __m128i n = _mm_cvtps_epi32(_mm_mul_ps(v, scale));
+                n = _mm_packus_epi16(_mm_packs_epi32(n, n), _mm_setzero_si128());
+                int packed = _mm_cvtsi128_si32(n);
+                std::memcpy(dst + i, &packed, 4);
+            }
+#endif
+            for (; i < tw * 4; ++i) {
+                dst[i] = to_byte(src[i]);
+            }
+        }
+    }
+
+
+    Canvas canvas;
+    glm::ivec2 size = { 1, 1 };
+    std::vector<unsigned char> pixels;
+    Color background = { 0.0f, 0.0f, 0.0f, 0.0f };
+    float pixel_ratio = 1.0f;
+
+    std::unordered_map<int, Texture> textures;
+    int next_texture = 1;
+
+    // The frame so far, kept between frames for their capacity.
+    std::vector<Call> calls;
+    std::vector<Shape> shapes;
+    std::vector<Edge> edges;
+
+    // Of the call and shape being recorded, in pixels.
+    glm::ivec4 clip;
+    glm::vec2 bounds_min, bounds_max;
+
+    WorkerPool pool;
+    std::vector<Scratch> scratch; // one per thread of the pool
+
+    glm::ivec2 tiles;
+    std::atomic<std::size_t> next{ 0 };
+};
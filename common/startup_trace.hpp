@@ -0,0 +1,116 @@
+#pragma once
+#include <cstdint>
+#include <cstdio>
+#include <vector>
+
+#include <SDL.h>
+
+/*
+    Times the steps between launch and the first presented frame. Phases are recorded through
+    StartupPhase scopes until the first frame is marked, after that startup is over and they
+    are ignored. Time is measured from the first call to get(), so make that early in main.
+*/
+
+struct StartupSample {
+    const char* name; // must outlive the trace, usually a string literal
+    std::uint64_t start, end;
+    int depth;
+};
+
+
+class StartupTrace {
+public:
+
+    static StartupTrace& get() {
+        static StartupTrace trace;
+        return trace;
+    }
+
+    // Returns the phase to hand to end_phase, or no_phase once startup is over.
+    std::size_t begin_phase(const char* name) {
+        if (first_frame) {
+            return no_phase;
+        }
+        phases.push_back({ name, SDL_GetPerformanceCounter(), 0, depth++ });
+        return phases.size() - 1;
+    }
+
+    void end_phase(std::size_t phase) {
+        if (phase < phases.size() && !phases[phase].end) {
+            phases[phase].end = SDL_GetPerformanceCounter();
+            --depth;
+        }
+    }
+
+    // Ends startup, true only for the first call.
+    bool mark_first_frame() {
+        if (first_frame) {
+            return false;
+        }
+        first_frame = SDL_GetPerformanceCounter();
+        return true;
+    }
+
+    bool is_complete() const {
+        return first_frame != 0;
+    }
+
+    // Negative until the first frame has been presented.
+    double get_time_to_first_frame_ms() const {
+        return first_frame ? to_ms(first_frame - epoch) : -1.0;
+    }
+
+    const std::vector<StartupSample>& get_phases() const {
+        return phases;
+    }
+
+    std::uint64_t get_epoch() const {
+        return epoch;
+    }
+
+    std::uint64_t get_first_frame() const {
+        return first_frame;
+    }
+
+    double to_ms(std::uint64_t ticks) const {
+        return ticks * 1000.0 / frequency;
+    }
+
+
+    void print() const {
+        printf("Startup: %.1f ms to first frame\n", get_time_to_first_frame_ms());
+        for (auto& phase : phases) {
+            std::uint64_t end = phase.end ? phase.end : phase.start;
+            printf("  %*s%-*s %8.1f ms\n", phase.depth * 2, "", 20 - phase.depth * 2, phase.name, to_ms(end - phase.start));
+        }
+    }
+
+    static const std::size_t no_phase = ~(std::size_t)0;
+
+private:
+
+    StartupTrace() : frequency(SDL_GetPerformanceFrequency()), epoch(SDL_GetPerformanceCounter()) { }
+
+    std::vector<StartupSample> phases;
+    int depth = 0;
+
+    std::uint64_t frequency, epoch;
+    std::uint64_t first_frame = 0;
+};
+
+
+// Times the enclosing scope as a startup phase.
+class StartupPhase {
+public:
+    StartupPhase(const char* name) : phase(StartupTrace::get().begin_phase(name)) { }
+
+    ~StartupPhase() {
+        StartupTrace::get().end_phase(phase);
+    }
+
+    StartupPhase(const StartupPhase&) = delete;
+    void operator=(const StartupPhase&) = delete;
+
+private:
+    std::size_t phase;
+};
@@ -0,0 +1,58 @@
+#pragma once
+
+#include <tuple>
+#include <utility>
+
+namespace detail {
+
+    template <class Listener, class Message>
+    auto bus_handle(Listener& listener, const Message& message, int) -> decltype(listener.handle(message), void()) {
+        listener.handle(message);
+    }
+
+    // Listeners without a handle() overload for the message are skipped at compile time.
+    template <class Listener, class Message>
+    void bus_handle(Listener&, const Message&, long) { }
+
+}
+
+/*
+    Event bus whose listeners are fixed at compile time. Emitting a message calls handle(message)
+    on every listener that has an overload for it, directly rather than through a Delegate, so
+    the whole dispatch can be inlined. Use Event for anything that subscribes at runtime.
+
+        StaticBus<Layout, Renderer> bus(layout, renderer);
+        bus.emit(Resized { size });
+*/
+template <class ...Listeners>
+class StaticBus {
+public:
+
+    StaticBus(Listeners&... listeners) : listeners(listeners...) { }
+
+    template <class Message>
+    void emit(const Message& message) {
+        emit(message, std::index_sequence_for<Listeners...>());
+    }
+
+    template <std::size_t I>
+    typename std::tuple_element<I, std::tuple<Listeners...>>::type& get() {
+        return std::get<I>(listeners);
+    }
+
+private:
+
+    template <class Message, std::size_t ...I>
+    void emit(const Message& message, std::index_sequence<I...>) {
+        int expand[] = { 0, (detail::bus_handle(std::get<I>(listeners), message, 0), 0)... };
+        (void)expand;
+    }
+
+    std::tuple<Listeners&...> listeners;
+};
+
+
+template <class ...Listeners>
+StaticBus<Listeners...> make_static_bus(Listeners&... listeners) {
+    return StaticBus<Listeners...>(listeners...);
+}
@@ -1,16 +1,33 @@
 #pragma once
+#include <algorithm>
 #include <string>
+#include <fstream>
 #include <functional>
+#include <memory>
+#include <vector>
 
 #include <SDL.h>
 #include <GL/glew.h>
 #include <nanovg.h>
 #define NANOVG_GL3_IMPLEMENTATION
 #include <nanovg_gl.h>
+#include <nanovg_gl_utils.h>
 #include <glm/glm.hpp>
 
+#include "asset_loader.hpp"
 #include "canvas.hpp"
+#include "damage.hpp"
+#include "dynamic_resolution.hpp"
 #include "event.hpp"
+#include "frame_pacer.hpp"
+#include "frame_profiler.hpp"
+#include "input_latency.hpp"
+#include "input_recorder.hpp"
+#include "layer_cache.hpp"
+#include "render_device.hpp"
+#include "render_profile.hpp"
+#include "render_thread.hpp"
+#include "startup_trace.hpp"
 
 class Window {
 public:
@@ -19,34 +36,49 @@ public:
         glm::ivec2 size;
     };
 
-    Window() { }
+    Window() {
+        // Drags and resizes produce many samples a frame, handlers only need to see the last one.
+        on_motion.set_coalescing(Coalesce::latest);
+        on_resize.set_coalescing(Coalesce::latest);
+    }
+
+    Window(const Window&) = delete;
+    void operator=(const Window&) = delete;
+
+    ~Window() {
+        unregister_window();
+    }
 
-    void create(const std::string& title, int width, int height) {
+    /*
+        With `render_thread` set the GL context moves to a RenderThread after setup. Canvas then
+        records into CommandLists which the render thread replays and presents, so a blocking
+        swap no longer holds up event processing. GPU timer queries are not available then.
+        `profile` picks the antialiasing, see RenderProfile.
+    */
+    bool create(const std::string& title, int width, int height, bool render_thread = false,
+                RenderProfile profile = RenderProfile::balanced) {
         settings = {
             { width, height }
         };
+        render_profile = profile;
 
-        SDL_Init(SDL_INIT_EVERYTHING);
-
-        // Setup the window attributes
-        SDL_GL_SetAttribute(SDL_GL_CONTEXT_MAJOR_VERSION, 3);
-        SDL_GL_SetAttribute(SDL_GL_CONTEXT_MINOR_VERSION, 3);
-        SDL_GL_SetAttribute(SDL_GL_ACCELERATED_VISUAL, 1);
-
-        SDL_GL_SetAttribute(SDL_GL_MULTISAMPLEBUFFERS, 1);
-        SDL_GL_SetAttribute(SDL_GL_MULTISAMPLESAMPLES, 4);
-
-        // Create the window
-        window = SDL_CreateWindow(title.c_str(),
-                                  SDL_WINDOWPOS_CENTERED, SDL_WINDOWPOS_CENTERED,
-                                  width, height,
-                                  SDL_WINDOW_OPENGL | SDL_WINDOW_RESIZABLE | SDL_WINDOW_SHOWN);
+        {
+            StartupPhase phase("sdl init");
+            if (!init_sdl()) {
+                return false;
+            }
+        }
 
-        // Create the rendering contexts
-        gl_context = SDL_GL_CreateContext(window);
+        int samples = RenderSettings::get(profile).msaa_samples;
+        if (!open_window(title, { SDL_WINDOWPOS_CENTERED, SDL_WINDOWPOS_CENTERED }, samples)) {
+            return false;
+        }
 
-        glewExperimental = true;
-        glewInit();
+        {
+            StartupPhase phase("glew init");
+            glewExperimental = true;
+            glewInit();
+        }
 
         GLenum r = glGetError();
         if (r != GL_INVALID_ENUM) {
@@ -58,79 +90,1008 @@ public:
                 glGetString(GL_VERSION),
                 glGetString(GL_SHADING_LANGUAGE_VERSION));
 
-        canvas = Canvas(nvgCreateGL3(NVG_STENCIL_STROKES | NVG_ANTIALIAS | NVG_DEBUG));
+        // Don't leave the frame rate up to the driver's default swap interval.
+        pacer.set_mode(window, Pacing::vsync);
+
+        StartupPhase phase("nanovg");
+        if (render_thread) {
+            int flags = RenderSettings::get(profile).nvg_flags;
+            canvas = Canvas(CanvasRecorder::create((flags & NVG_ANTIALIAS) != 0));
+            renderer.reset(new RenderThread());
+            renderer->set_present_callback([this](const CommandList& list) {
+                record_latency(list.input_time, list.latch_time);
+            });
+            renderer->start(window, gl_context, &nvgCreateGL3, &nvgDeleteGL3, flags);
+        } else {
+            canvas = Canvas(nullptr);
+            device = std::make_shared<RenderDevice>(gl_context, canvas, profile, samples);
+            device->attach(window);
+            create_renderer();
+        }
+
+        // Let worker threads posting events wake us up while we are waiting for input.
+        get_wake_event();
+        EventQueue::main().set_wake(&wake);
+        register_window();
+        return true;
+    }
+
+
+    /*
+        Opens another window that draws with `shared`, the device of an existing window (see
+        get_device), e.g. for a detached panel. Fonts, images, the glyph atlas and cached layers
+        are the device's, so they aren't loaded again. Input for all windows is handed out by
+        whichever one calls process_events.
+    */
+    bool create(const std::string& title, int width, int height, const std::shared_ptr<RenderDevice>& shared) {
+        settings = {
+            { width, height }
+        };
+        render_profile = shared->get_profile();
+
+        SDL_GL_SetAttribute(SDL_GL_MULTISAMPLEBUFFERS, shared->get_samples() > 0 ? 1 : 0);
+        SDL_GL_SetAttribute(SDL_GL_MULTISAMPLESAMPLES, shared->get_samples());
+
+        window = SDL_CreateWindow(title.c_str(), SDL_WINDOWPOS_CENTERED, SDL_WINDOWPOS_CENTERED, width, height,
+                                  SDL_WINDOW_OPENGL | SDL_WINDOW_RESIZABLE | SDL_WINDOW_SHOWN);
+        if (!window) {
+            printf("Error creating window: %s\n", SDL_GetError());
+            return false;
+        }
+
+        device = shared;
+        device->attach(window);
+        SDL_GL_MakeCurrent(window, device->get_gl_context());
+        gl_context = device->get_gl_context();
+        canvas = device->get_canvas();
+
+        // Only one window waits for the vertical blank, or they would take turns waiting for it. The
+        // interval is only set when this window presents, the context is the other window's too.
+        pacer.choose_mode(window, Pacing::unlimited);
+
+        register_window();
+        return true;
+    }
+
+
+    // Creates a window on SDL's dummy video driver without any GL context, frames are not rendered.
+    void create_headless(const std::string& title, int width, int height) {
+        settings = {
+            { width, height }
+        };
+
+        SDL_setenv("SDL_VIDEODRIVER", "dummy", 1);
+        {
+            StartupPhase phase("sdl init");
+            init_sdl();
+        }
+
+        window = SDL_CreateWindow(title.c_str(), 0, 0, width, height, 0);
+        pacer.set_mode(window, Pacing::unlimited);
+
+        get_wake_event();
+        EventQueue::main().set_wake(&wake);
+        register_window();
+    }
+
+
+    /*
+        Renders with a real GL context without ever showing the window. Frames go to an
+        offscreen framebuffer and are read back into memory, for benchmarks on machines without
+        a GPU or a display. With `software` Mesa's llvmpipe is forced so timings compare across
+        machines. The context still comes from an X server, Xvfb is enough. The target is not
+        multisampled, so the MSAA of `profile` does not apply.
+    */
+    bool create_offscreen(const std::string& title, int width, int height, bool software = true,
+                          RenderProfile profile = RenderProfile::balanced) {
+        settings = {
+            { width, height }
+        };
+        render_profile = profile;
+
+        // Don't override a driver the user picked explicitly.
+        if (software) {
+            SDL_setenv("LIBGL_ALWAYS_SOFTWARE", "1", 0);
+        }
+
+        {
+            StartupPhase phase("sdl init");
+            if (!init_sdl()) {
+                return false;
+            }
+        }
+
+        // Software drivers often only offer GL 3.3 as a core profile.
+        SDL_GL_SetAttribute(SDL_GL_CONTEXT_MAJOR_VERSION, 3);
+        SDL_GL_SetAttribute(SDL_GL_CONTEXT_MINOR_VERSION, 3);
+        SDL_GL_SetAttribute(SDL_GL_CONTEXT_PROFILE_MASK, SDL_GL_CONTEXT_PROFILE_CORE);
+
+        {
+            StartupPhase phase("create window");
+            window = SDL_CreateWindow(title.c_str(), 0, 0, width, height, SDL_WINDOW_OPENGL | SDL_WINDOW_HIDDEN);
+        }
+        if (window) {
+            StartupPhase phase("gl context");
+            gl_context = SDL_GL_CreateContext(window);
+        }
+        if (!gl_context) {
+            printf("Error creating an offscreen GL context: %s\n", SDL_GetError());
+            close();
+            return false;
+        }
+
+        {
+            StartupPhase phase("glew init");
+            glewExperimental = true;
+            glewInit();
+            glGetError(); // GLEW trips GL_INVALID_ENUM on core profiles
+        }
+
+        printf("OpenGL: %s (%s)\n", glGetString(GL_VERSION), glGetString(GL_RENDERER));
+
+        StartupPhase phase("nanovg");
+        canvas = Canvas(nullptr);
+        device = std::make_shared<RenderDevice>(gl_context, canvas, profile, 0);
+        device->attach(window);
+        render_offscreen = true;
+        create_renderer();
+        pixels.resize((std::size_t)width * height * 4);
+
+        pacer.set_mode(window, Pacing::unlimited);
+
+        get_wake_event();
+        EventQueue::main().set_wake(&wake);
+        register_window();
+        return true;
     }
 
 
     void close() {
-        nvgDeleteGL3(canvas.get_context());
-        SDL_GL_DeleteContext(gl_context);
+        // Nothing loaded after this may touch the canvas.
+        assets.stop();
+
+        if (renderer) {
+            // Hands the GL context back once the last frame has been presented.
+            renderer.reset();
+            nvgDeleteInternal(canvas.get_context());
+            SDL_GL_MakeCurrent(window, gl_context);
+            SDL_GL_DeleteContext(gl_context);
+        } else if (device) {
+            device->make_current(window);
+            set_dynamic_resolution(false);
+            set_damage_tracking(false);
+            release_targets();
+
+            // The last window takes nanovg down with it, the GL context goes with the device.
+            if (device->detach(window) == 0) {
+                device->release();
+            }
+            device.reset();
+        } else if (gl_context) {
+            SDL_GL_DeleteContext(gl_context);
+        }
         SDL_DestroyWindow(window);
+        unregister_window();
 
         window = nullptr;
         gl_context = nullptr;
+        canvas = nullptr;
+        render_offscreen = false;
+    }
+
+
+    /*
+        Only video and events are started with the window. Anything else (audio, joysticks,
+        game controllers, haptics, timers) is brought up here the first time it is needed,
+        returns false if one of them failed to start.
+    */
+    static bool use_subsystems(Uint32 flags) {
+        Uint32 missing = flags & ~SDL_WasInit(flags);
+        if (missing && SDL_InitSubSystem(missing) != 0) {
+            printf("Error initializing SDL subsystems: %s\n", SDL_GetError());
+            return false;
+        }
+        return true;
+    }
+
+
+    bool is_headless() const {
+        return gl_context == nullptr;
+    }
+
+    bool is_offscreen() const {
+        return render_offscreen;
+    }
+
+    // The last frame of an offscreen window as RGBA, rows from the bottom up as GL returns them.
+    const std::vector<unsigned char>& get_pixels() const {
+        return pixels;
+    }
+
+    // Writes the last offscreen frame as a binary PPM.
+    bool save_frame(const std::string& filename) const {
+        std::ofstream out(filename, std::ios::binary);
+        if (!out || pixels.empty()) {
+            printf("Error saving frame to '%s'\n", filename.c_str());
+            return false;
+        }
+
+        int w = settings.size.x, h = settings.size.y;
+        out << "P6\n" << w << " " << h << "\n255\n";
+        for (int y = h - 1; y >= 0; --y) {
+            for (int x = 0; x < w; ++x) {
+                out.write(reinterpret_cast<const char*>(&pixels[((std::size_t)y * w + x) * 4]), 3);
+            }
+        }
+        return true;
+    }
+
+
+    /*
+        With redraw on demand process_events blocks until there is something to do, and
+        needs_redraw only says yes after input, a posted event, a redraw deadline passing or a
+        call to request_redraw. Without it every frame is drawn, as fast as the loop spins.
+    */
+    void set_redraw_on_demand(bool enabled) {
+        redraw_on_demand = enabled;
+        redraw_requested = true;
+    }
+
+    void request_redraw() {
+        redraw_requested = true;
+    }
+
+    // Redraw once `ms` milliseconds from now, e.g. for the next step of an animation.
+    void request_redraw_after(Uint32 ms) {
+        Uint32 deadline = SDL_GetTicks() + ms;
+        if (!redraw_deadline || SDL_TICKS_PASSED(redraw_deadline, deadline)) {
+            redraw_deadline = deadline;
+        }
+    }
+
+    bool needs_redraw() const {
+        return !redraw_on_demand || redraw_requested;
+    }
+
+
+    // `fps` is only used by Pacing::capped, the other modes follow the display's refresh rate.
+    void set_pacing(Pacing mode, double fps = 0.0) {
+        pacing_fps = fps;
+
+        // The swap interval belongs to the context, so it has to be set where the context is current.
+        // A context other windows present with too gets it from present instead.
+        if (renderer) {
+            renderer->invoke([&]() { pacer.set_mode(window, mode, fps); });
+        } else if (device && device->get_window_count() > 1) {
+            pacer.choose_mode(window, mode, fps);
+        } else {
+            pacer.set_mode(window, mode, fps);
+        }
+    }
+
+    const FramePacer& get_pacer() const {
+        return pacer;
+    }
+
+
+    /*
+        Switches antialiasing at runtime by creating the nanovg context again. A change of MSAA
+        sample count also needs a new window and GL context, since the sample count is fixed
+        when the window is made. Canvas copies follow along and fonts are loaded again, cached
+        layers are redrawn, but images made through the old context are gone. Not available
+        with the render thread.
+    */
+    bool set_render_profile(RenderProfile profile) {
+        if (renderer || is_headless() || device->get_window_count() > 1) {
+            printf("Render profiles can only be switched with a GL context on the main thread that no other window shares\n");
+            return false;
+        }
+        if (profile == render_profile) {
+            return true;
+        }
+
+        int samples = RenderSettings::get(profile).msaa_samples;
+        bool new_window = !render_offscreen && samples != device->get_samples();
+        render_profile = profile;
+
+        release_targets();
+        device->release();
+
+        if (new_window) {
+            std::string title = SDL_GetWindowTitle(window);
+            glm::ivec2 pos;
+            SDL_GetWindowPosition(window, &pos.x, &pos.y);
+
+            device->detach(window);
+            device.reset();
+            SDL_DestroyWindow(window);
+            gl_context = nullptr;
+
+            if (!open_window(title, pos, samples)) {
+                canvas.set_context(nullptr);
+                return false;
+            }
+            glewExperimental = true;
+            glewInit();
+            glGetError(); // GLEW trips GL_INVALID_ENUM, as on startup
+
+            pacer.set_mode(window, pacer.get_mode(), pacing_fps);
+            set_background(clear_color);
+
+            device = std::make_shared<RenderDevice>(gl_context, canvas, profile, samples);
+            device->attach(window);
+        } else {
+            device->set_profile(profile);
+        }
+
+        create_renderer();
+        invalidate_all();
+        return true;
+    }
+
+    RenderProfile get_render_profile() const {
+        return render_profile;
+    }
+
+
+    /*
+        Renders the scene into an offscreen target scaled down to as little as `min_scale` of
+        the window, picked from GPU frame times to fit the pacer's budget, and upscales it.
+        Text is drawn afterwards at full resolution on top. Uses the FrameProfiler's timer
+        queries, so it turns the profiler on, and needs the GL context on this thread.
+    */
+    void set_dynamic_resolution(bool enabled, float min_scale = 0.5f) {
+        if (enabled && (renderer || is_headless() || damage_tracking)) {
+            printf("Dynamic resolution needs a GL context on the main thread and no damage tracking\n");
+            return;
+        }
+
+        dynamic_resolution = enabled;
+        resolution.set_range(min_scale);
+        resolution.reset();
+
+        if (enabled) {
+            FrameProfiler::get().set_enabled(true);
+        } else if (scene) {
+            nvgluDeleteFramebuffer(scene);
+            scene = nullptr;
+        }
+    }
+
+    float get_render_scale() const {
+        return dynamic_resolution ? resolution.get_scale() : 1.0f;
+    }
+
+
+    /*
+        With damage tracking the frame is kept in a persistent framebuffer and only the
+        regions invalidated since the last frame are cleared and drawn again, each clipped to
+        its region, before the whole thing is copied to the window. Draw through draw_regions
+        and skip whatever does not intersect the region it passes.
+    */
+    void set_damage_tracking(bool enabled) {
+        if (enabled && (renderer || is_headless() || dynamic_resolution)) {
+            printf("Damage tracking needs a GL context on the main thread and no dynamic resolution\n");
+            return;
+        }
+
+        damage_tracking = enabled;
+        damage.set_bounds(settings.size);
+        damage.add_all();
+
+        if (!enabled && retained) {
+            nvgluDeleteFramebuffer(retained);
+            retained = nullptr;
+        }
+    }
+
+    // Marks an area of the window as changed and asks for a redraw.
+    void invalidate(const glm::vec2& min, const glm::vec2& max) {
+        if (damage_tracking) {
+            damage.add(min, max);
+        }
+        request_redraw();
+    }
+
+    void invalidate_all() {
+        if (damage_tracking) {
+            damage.add_all();
+        }
+        request_redraw();
+    }
+
+    // Calls `draw` once per damaged region with the canvas clipped to it, or once for the whole window without damage tracking.
+    void draw_regions(const std::function<void(const DamageRect&)>& draw) {
+        if (!damage_tracking) {
+            draw({ glm::ivec2(0), settings.size });
+            return;
+        }
+
+        for (auto& region : damage.get_regions()) {
+            glm::ivec2 size = region.get_size();
+
+            // nanovg turns the GL scissor off when it flushes, it only matters for the clear.
+            glEnable(GL_SCISSOR_TEST);
+            glScissor(region.min.x, settings.size.y - region.max.y, size.x, size.y);
+            glClear(GL_COLOR_BUFFER_BIT | GL_STENCIL_BUFFER_BIT);
+            glDisable(GL_SCISSOR_TEST);
+
+            canvas.begin_frame(settings.size);
+            canvas.scissor(region.min, size);
+            draw(region);
+            canvas.end_frame();
+        }
+    }
+
+
+    // Layers drawn through Canvas::layer, set their memory budget or invalidate them here. Not with the render thread.
+    LayerCache& get_layers() {
+        return device->get_layers();
+    }
+
+    // What this window draws with, hand it to create to open more windows on the same fonts, images and layers.
+    const std::shared_ptr<RenderDevice>& get_device() const {
+        return device;
     }
 
 
     void begin_frame() {
-        glClear(GL_COLOR_BUFFER_BIT);
+        redraw_requested = false;
+        pacer.begin_frame();
+
+        if (is_headless()) {
+            return;
+        }
+        if (!renderer) {
+            // Another window on the device may have drawn since, with its own viewport and clear colour.
+            device->make_current(window);
+            glViewport(0, 0, settings.size.x, settings.size.y);
+            glClearColor(clear_color.r, clear_color.g, clear_color.b, clear_color.a);
+            device->get_layers().begin_frame();
+
+            FrameProfiler::get().begin_gpu();
+            if (dynamic_resolution) {
+                begin_scene();
+                return;
+            }
+            if (damage_tracking) {
+                begin_retained();
+                return;
+            }
+            if (offscreen) {
+                nvgluBindFramebuffer(offscreen);
+                glViewport(0, 0, settings.size.x, settings.size.y);
+            }
+            glClear(GL_COLOR_BUFFER_BIT);
+        }
         canvas.begin_frame(settings.size);
     }
 
 
     void end_frame() {
-        canvas.end_frame();
-        SDL_GL_SwapWindow(window);
+        if (renderer) {
+            {
+                ProfileZone zone("record");
+                run_late_latch();
+                canvas.end_frame();
+            }
+
+            // Only waits when the render thread is still busy with the frame before last.
+            ProfileZone zone("submit");
+            auto& list = CanvasRecorder::get(canvas.get_context()).get_list();
+            list.clear_color = clear_color;
+            list.input_time = frame_input;
+            list.latch_time = frame_latch;
+            frame_input = frame_latch = 0;
+            renderer->submit(list);
+        } else if (!is_headless()) {
+            {
+                ProfileZone zone("render");
+                if (damage_tracking) {
+                    composite(retained);
+                    damage.clear();
+                } else {
+                    // With dynamic resolution the late pass goes over the scaled scene in end_scene.
+                    if (!dynamic_resolution) {
+                        run_late_latch();
+                    }
+                    canvas.end_frame();
+                }
+                if (dynamic_resolution) {
+                    end_scene();
+                }
+            }
+            FrameProfiler::get().end_gpu();
+
+            if (offscreen) {
+                // Reading back also waits for the GPU, so frame times include the rendering.
+                ProfileZone zone("readback");
+                glReadPixels(0, 0, settings.size.x, settings.size.y, GL_RGBA, GL_UNSIGNED_BYTE, pixels.data());
+            } else {
+                ProfileZone zone("present");
+                device->present(window, pacer.get_swap_interval());
+            }
+            record_latency(frame_input, frame_latch);
+            frame_input = frame_latch = 0;
+        } else {
+            late.clear();
+        }
+        FrameProfiler::get().end_frame();
+        pacer.end_frame();
+
+        if (StartupTrace::get().mark_first_frame()) {
+            StartupTrace::get().print();
+        }
+    }
+
+
+    // Writes every event process_events consumes to `filename` until the window is destroyed.
+    bool record_input(const std::string& filename) {
+        recorder.reset(new InputRecorder());
+        if (!recorder->open(filename)) {
+            recorder.reset();
+            return false;
+        }
+        return true;
     }
 
 
     void process_events() {
+        if (recorder) {
+            recorder->begin_frame();
+        }
+
         SDL_Event event;
-        while (SDL_PollEvent(&event)) {
-            switch (event.type) {
+        bool idle = std::none_of(get_windows().begin(), get_windows().end(), [](Window* w) { return w->needs_redraw(); });
+        bool waited = redraw_on_demand && !redraw_requested && idle && wait_event(event);
 
-            case SDL_WINDOWEVENT:
-                if (event.window.event == SDL_WINDOWEVENT_RESIZED) {
-                    update_resolution(event.window.data1, event.window.data2);
-                    on_resize({ event.window.data1, event.window.data2 });
-                }
-                break;
+        // Time spent waiting for input is not part of the frame.
+        FrameProfiler::get().begin_frame();
+        ProfileZone zone("events");
 
-            case SDL_QUIT: on_quit(); break;
+        while (waited || SDL_PollEvent(&event)) {
+            waited = false;
+            if (recorder) {
+                recorder->record(event);
+            }
+            Window* target = route(event);
+            if (is_input(event) && !target->frame_input) {
+                target->frame_input = LatencyMeter::from_timestamp(event.common.timestamp);
+            }
+            target->handle_event(event);
+            target->redraw_requested = true;
+        }
 
-            case SDL_KEYDOWN: on_keydown(event.key.keysym.sym); break;
-            case SDL_KEYUP: on_keyup(event.key.keysym.sym); break;
+        for (auto w : get_windows()) {
+            if (w != this) {
+                w->finish_window_events();
+            }
+        }
+        finish_events();
+    }
+
+
+    // Runs a recorded session through the on_* events as fast as possible, calling `frame` after each recorded frame.
+    ReplayReport replay(const InputLog& log, const std::function<void()>& frame) {
+        ReplayReport report;
+        double ticks_to_ms = 1000.0 / SDL_GetPerformanceFrequency();
 
-            case SDL_MOUSEBUTTONDOWN: on_buttondown(event.button.button); break;
-            case SDL_MOUSEBUTTONUP: on_buttonup(event.button.button); break;
-            case SDL_MOUSEMOTION: on_motion({ event.motion.x, event.motion.y }); break;
+        for (auto& f : log.get_frames()) {
+            Uint64 start = SDL_GetPerformanceCounter();
+            FrameProfiler::get().begin_frame();
+
+            {
+                ProfileZone zone("events");
+                for (auto& event : f.events) {
+                    handle_event(event);
+                }
+                finish_events();
             }
+            frame();
+
+            report.frame_ms.push_back((SDL_GetPerformanceCounter() - start) * ticks_to_ms);
+        }
+        return report;
+    }
+
+    /*
+        For latency critical elements like drag previews and cursors. `draw` runs at the very
+        end of this frame's end_frame, on top of everything else, with the cursor re-read from
+        SDL right then instead of the position on_motion reported at the top of the frame.
+        Registrations only last for the current frame.
+    */
+    void late_latch(const std::function<void(Canvas&, const glm::ivec2&)>& draw) {
+        late.push_back(draw);
+    }
+
+    // The cursor as SDL sees it now, after pumping pending input. Replays use the last recorded position.
+    glm::ivec2 latch_cursor() {
+        if (is_headless() || offscreen) {
+            return cursor;
         }
+        SDL_PumpEvents();
+        SDL_GetMouseState(&cursor.x, &cursor.y);
+        return cursor;
+    }
+
+    /*
+        Time from the SDL timestamp of the oldest input a frame consumed to SDL_GL_SwapWindow
+        returning for it (or the read back of an offscreen frame). Drivers may return from the
+        swap before the image is on screen, so this is a lower bound on what the user sees.
+    */
+    const LatencyMeter& get_input_latency() const {
+        return input_latency;
+    }
+
+    // Time from the late latch to the present, for frames that drew anything through late_latch.
+    const LatencyMeter& get_latch_latency() const {
+        return latch_latency;
     }
 
     Canvas& get_canvas() {
         return canvas;
     }
 
+    /*
+        Reads a font on the asset thread and loads it from memory once it arrives, so big font
+        files don't delay the first frame. Until then text set in `name` uses the canvas'
+        placeholder font, or isn't drawn without one. Cached layers and retained damage are
+        thrown away when it lands since they may hold text in the placeholder.
+    */
+    void load_font_async(const std::string& name, const std::string& filename) {
+        canvas.add_pending_font(name);
+        assets.load(filename, [this, name, filename](AssetData data) {
+            if (!data) {
+                return;
+            }
+            canvas.load_font(name, data, filename);
+            if (device) {
+                device->get_layers().clear();
+            }
+            invalidate_all();
+            on_font_loaded(name);
+        });
+    }
+
+    // Waits for every outstanding asset load and applies it, for runs that need the final result on the first frame.
+    void finish_loading() {
+        assets.finish();
+    }
+
+    AssetLoader& get_assets() {
+        return assets;
+    }
+
     void set_background(const Color& color) {
-        glClearColor(color.r, color.g, color.b, color.a);
+        clear_color = color.v;
+        if (!is_headless() && !renderer) {
+            glClearColor(color.r, color.g, color.b, color.a);
+        }
     }
 
     // Event callbacks
-    Event<> on_quit;
-    Event<glm::ivec2> on_resize;
+    Event<> on_quit { "window.on_quit" };
+    Event<> on_close { "window.on_close" }; // this window's close button, on_quit only follows once the last one is closed
+    Event<glm::ivec2> on_resize { "window.on_resize" };
+
+    Event<SDL_Keycode> on_keydown { "window.on_keydown" }, on_keyup { "window.on_keyup" };
+    Event<int> on_buttondown { "window.on_buttondown" }, on_buttonup { "window.on_buttonup" };
 
-    Event<SDL_Keycode> on_keydown, on_keyup;
-    Event<int> on_buttondown, on_buttonup;
+    Event<glm::ivec2> on_motion { "window.on_motion" }; // coalesced, fires at most once per frame
+    Event<glm::ivec2> on_raw_motion { "window.on_raw_motion" }; // fires for every motion sample SDL reports
 
-    Event<glm::ivec2> on_motion;
+    Event<std::string> on_font_loaded { "window.on_font_loaded" };
 
 private:
 
+    void handle_event(const SDL_Event& event) {
+        switch (event.type) {
+
+        case SDL_WINDOWEVENT:
+            if (event.window.event == SDL_WINDOWEVENT_RESIZED) {
+                update_resolution(event.window.data1, event.window.data2);
+                on_resize.coalesce({ event.window.data1, event.window.data2 });
+            } else if (event.window.event == SDL_WINDOWEVENT_CLOSE) {
+                on_close();
+            }
+            break;
+
+        case SDL_QUIT: on_quit(); break;
+
+        case SDL_KEYDOWN: on_keydown(event.key.keysym.sym); break;
+        case SDL_KEYUP: on_keyup(event.key.keysym.sym); break;
+
+        // Flush the pending motion first so button handlers see the cursor where the click happened.
+        case SDL_MOUSEBUTTONDOWN: on_motion.flush_coalesced(); on_buttondown(event.button.button); break;
+        case SDL_MOUSEBUTTONUP: on_motion.flush_coalesced(); on_buttonup(event.button.button); break;
+
+        case SDL_MOUSEMOTION:
+            cursor = { event.motion.x, event.motion.y };
+            on_raw_motion({ event.motion.x, event.motion.y });
+            on_motion.coalesce({ event.motion.x, event.motion.y });
+            break;
+        }
+    }
+
+    void finish_events() {
+        finish_window_events();
+
+        // Deliver everything worker threads posted since the last frame in one batch.
+        if (EventQueue::main().drain()) {
+            for (auto w : get_windows()) {
+                w->redraw_requested = true;
+            }
+            redraw_requested = true;
+        }
+    }
+
+    // The coalesced input and redraw deadline of this window alone.
+    void finish_window_events() {
+        on_resize.dispatch_coalesced();
+        on_motion.dispatch_coalesced();
+
+        if (redraw_deadline && SDL_TICKS_PASSED(SDL_GetTicks(), redraw_deadline)) {
+            redraw_deadline = 0;
+            redraw_requested = true;
+        }
+    }
+
+    // Sleeps until an event arrives or the earliest redraw deadline of any window passes, returns true if `event` was filled in.
+    bool wait_event(SDL_Event& event) {
+        Uint32 deadline = redraw_deadline;
+        for (auto w : get_windows()) {
+            if (w->redraw_deadline && (!deadline || SDL_TICKS_PASSED(deadline, w->redraw_deadline))) {
+                deadline = w->redraw_deadline;
+            }
+        }
+
+        if (!deadline) {
+            return SDL_WaitEvent(&event) == 1;
+        }
+
+        Uint32 now = SDL_GetTicks();
+        if (SDL_TICKS_PASSED(now, deadline)) {
+            return false;
+        }
+        return SDL_WaitEventTimeout(&event, deadline - now) == 1;
+    }
+
+    // Every created window, so input can go to the window it happened in whichever one polls for it.
+    static std::vector<Window*>& get_windows() {
+        static std::vector<Window*> windows;
+        return windows;
+    }
+
+    void register_window() {
+        unregister_window();
+        get_windows().push_back(this);
+    }
+
+    void unregister_window() {
+        auto& windows = get_windows();
+        windows.erase(std::remove(windows.begin(), windows.end(), this), windows.end());
+    }
+
+    // The window an event happened in, this one for events that don't belong to a window.
+    Window* route(const SDL_Event& event) {
+        Uint32 id = 0;
+        switch (event.type) {
+        case SDL_WINDOWEVENT: id = event.window.windowID; break;
+        case SDL_KEYDOWN: case SDL_KEYUP: id = event.key.windowID; break;
+        case SDL_TEXTINPUT: id = event.text.windowID; break;
+        case SDL_MOUSEMOTION: id = event.motion.windowID; break;
+        case SDL_MOUSEBUTTONDOWN: case SDL_MOUSEBUTTONUP: id = event.button.windowID; break;
+        case SDL_MOUSEWHEEL: id = event.wheel.windowID; break;
+        }
+
+        if (id && (!window || SDL_GetWindowID(window) != id)) {
+            for (auto w : get_windows()) {
+                if (w->window && SDL_GetWindowID(w->window) == id) {
+                    return w;
+                }
+            }
+        }
+        return this;
+    }
+
+    // Creates the window and its GL context, `samples` drops to 0 if the driver has no MSAA visual.
+    bool open_window(const std::string& title, const glm::ivec2& pos, int& samples) {
+        SDL_GL_SetAttribute(SDL_GL_CONTEXT_MAJOR_VERSION, 3);
+        SDL_GL_SetAttribute(SDL_GL_CONTEXT_MINOR_VERSION, 3);
+        SDL_GL_SetAttribute(SDL_GL_ACCELERATED_VISUAL, 1);
+
+        SDL_GL_SetAttribute(SDL_GL_MULTISAMPLEBUFFERS, samples > 0 ? 1 : 0);
+        SDL_GL_SetAttribute(SDL_GL_MULTISAMPLESAMPLES, samples);
+
+        {
+            StartupPhase phase("create window");
+            window = SDL_CreateWindow(title.c_str(), pos.x, pos.y, settings.size.x, settings.size.y,
+                                      SDL_WINDOW_OPENGL | SDL_WINDOW_RESIZABLE | SDL_WINDOW_SHOWN);
+        }
+        if (window) {
+            StartupPhase phase("gl context");
+            gl_context = SDL_GL_CreateContext(window);
+        }
+
+        if (!gl_context) {
+            printf("Error creating a GL context with %dx MSAA: %s\n", samples, SDL_GetError());
+            if (window) {
+                SDL_DestroyWindow(window);
+                window = nullptr;
+            }
+            if (samples == 0) {
+                return false;
+            }
+            samples = 0;
+            return open_window(title, pos, samples);
+        }
+        return true;
+    }
+
+    // The device's nanovg context plus this window's offscreen target, for the GL context that is current.
+    void create_renderer() {
+        device->create();
+        if (render_offscreen) {
+            offscreen = nvgluCreateFramebuffer(canvas.get_context(), settings.size.x, settings.size.y, 0);
+        }
+    }
+
+    // This window's framebuffers, the scaled scene and retained frame are made again on the next frame that needs them.
+    void release_targets() {
+        for (NVGLUframebuffer** target : { &scene, &retained, &offscreen }) {
+            if (*target) {
+                nvgluDeleteFramebuffer(*target);
+                *target = nullptr;
+            }
+        }
+    }
+
+    static bool is_input(const SDL_Event& event) {
+        switch (event.type) {
+        case SDL_KEYDOWN: case SDL_KEYUP: case SDL_TEXTINPUT:
+        case SDL_MOUSEBUTTONDOWN: case SDL_MOUSEBUTTONUP: case SDL_MOUSEMOTION: case SDL_MOUSEWHEEL:
+            return true;
+        }
+        return false;
+    }
+
+    // Draws what was registered with late_latch, as late in the frame as the canvas allows.
+    void run_late_latch() {
+        if (late.empty()) {
+            return;
+        }
+
+        glm::ivec2 p = latch_cursor();
+        frame_latch = SDL_GetPerformanceCounter();
+
+        canvas.push_state();
+        canvas.reset_transform();
+        canvas.reset_scissor();
+        for (auto& draw : late) {
+            draw(canvas, p);
+        }
+        canvas.pop_state();
+        late.clear();
+    }
+
+    // Called on the render thread when one is running.
+    void record_latency(std::uint64_t input, std::uint64_t latch) {
+        std::uint64_t presented = SDL_GetPerformanceCounter();
+        input_latency.add(input, presented);
+        latch_latency.add(latch, presented);
+    }
+
+    static bool init_sdl() {
+        if (SDL_Init(SDL_INIT_VIDEO | SDL_INIT_EVENTS) != 0) {
+            printf("Error initializing SDL: %s\n", SDL_GetError());
+            return false;
+        }
+        return true;
+    }
+
+    // User event pushed by EventQueue::main() to break us out of wait_event.
+    static Uint32 get_wake_event() {
+        static Uint32 type = SDL_RegisterEvents(1);
+        return type;
+    }
+
+    static void wake() {
+        SDL_Event event;
+        SDL_zero(event);
+        event.type = get_wake_event();
+        SDL_PushEvent(&event);
+    }
+
+    // Binds the offscreen target at the current render scale, reallocating it when that changed.
+    void begin_scene() {
+        update_render_scale();
+
+        glm::ivec2 size = glm::max(glm::ivec2(glm::vec2(settings.size) * resolution.get_scale()), glm::ivec2(1));
+        if (!scene || size != scene_size) {
+            if (scene) {
+                nvgluDeleteFramebuffer(scene);
+            }
+            scene = nvgluCreateFramebuffer(canvas.get_context(), size.x, size.y, 0);
+            scene_size = size;
+        }
+
+        nvgluBindFramebuffer(scene);
+        glViewport(0, 0, size.x, size.y);
+        glClear(GL_COLOR_BUFFER_BIT | GL_STENCIL_BUFFER_BIT);
+
+        canvas.defer_text(true);
+        canvas.begin_frame(settings.size, (float)size.x / settings.size.x);
+    }
+
+    // Stretches the scene over the window and draws the text held back while it was rendered.
+    void end_scene() {
+        canvas.defer_text(false);
+        composite(scene);
+    }
+
+    // Binds the framebuffer that keeps the last frame, a new one starts out fully damaged.
+    void begin_retained() {
+        damage.set_bounds(settings.size);
+        if (!retained || retained_size != settings.size) {
+            if (retained) {
+                nvgluDeleteFramebuffer(retained);
+            }
+            retained = nvgluCreateFramebuffer(canvas.get_context(), settings.size.x, settings.size.y, 0);
+            retained_size = settings.size;
+            damage.add_all();
+        }
+
+        nvgluBindFramebuffer(retained);
+        glViewport(0, 0, settings.size.x, settings.size.y);
+    }
+
+    // Draws `source` over the whole window, or the offscreen target, followed by any deferred text.
+    void composite(NVGLUframebuffer* source) {
+        nvgluBindFramebuffer(offscreen);
+        glViewport(0, 0, settings.size.x, settings.size.y);
+
+        canvas.begin_frame(settings.size);
+
+        canvas.begin_path();
+        canvas.rect({ 0, 0 }, settings.size);
+        canvas.fill(canvas.image_pattern({ 0, 0 }, settings.size, source->image));
+
+        canvas.draw_deferred_text();
+        run_late_latch();
+        canvas.end_frame();
+    }
+
+    // Feeds the newest GPU time that has not been used yet to the resolution controller.
+    void update_render_scale() {
+        auto& profiler = FrameProfiler::get();
+        for (std::size_t age = 0; age < profiler.get_frame_count(); ++age) {
+            auto& frame = profiler.get_frame(age);
+            if (frame.index < next_scaled_frame) {
+                break;
+            }
+            if (frame.gpu_ms >= 0.0) {
+                resolution.update(frame.gpu_ms, pacer.get_budget_ms());
+                next_scaled_frame = frame.index + 1;
+                break;
+            }
+        }
+    }
+
     void update_resolution(int width, int height) {
         settings.size = { width, height };
-        glViewport(0, 0, width, height);
 
+        // The render thread sets the viewport from every frame it replays.
+        if (!is_headless() && !renderer) {
+            glViewport(0, 0, width, height);
+        }
+
+        // The offscreen target and its read back buffer follow the window, replays resize it like a user would.
+        if (render_offscreen && offscreen) {
+            device->make_current(window);
+            nvgluDeleteFramebuffer(offscreen);
+            offscreen = nvgluCreateFramebuffer(canvas.get_context(), width, height, 0);
+            pixels.assign((std::size_t)width * height * 4, 0);
+        }
     }
 
     Settings settings;
@@ -138,4 +1099,40 @@ private:
     SDL_Window* window = nullptr;
     SDL_GLContext gl_context = nullptr;
     Canvas canvas = nullptr;
+
+    std::unique_ptr<InputRecorder> recorder;
+    FramePacer pacer;
+
+    std::unique_ptr<RenderThread> renderer;
+    glm::vec4 clear_color = glm::vec4(0.0f);
+
+    bool dynamic_resolution = false;
+    DynamicResolution resolution;
+    NVGLUframebuffer* scene = nullptr;
+    glm::ivec2 scene_size;
+    std::uint64_t next_scaled_frame = 0;
+
+    NVGLUframebuffer* offscreen = nullptr;
+    std::vector<unsigned char> pixels;
+
+    std::shared_ptr<RenderDevice> device; // null when headless or with the render thread
+    AssetLoader assets;
+
+    RenderProfile render_profile = RenderProfile::balanced;
+    bool render_offscreen = false; // set by create_offscreen, the target itself comes and goes with the renderer
+    double pacing_fps = 0.0;
+
+    glm::ivec2 cursor;
+    std::vector<std::function<void(Canvas&, const glm::ivec2&)>> late;
+    std::uint64_t frame_input = 0, frame_latch = 0; // performance counter values, 0 when there was none
+    LatencyMeter input_latency, latch_latency;
+
+    bool damage_tracking = false;
+    DamageTracker damage;
+    NVGLUframebuffer* retained = nullptr;
+    glm::ivec2 retained_size;
+
+    bool redraw_on_demand = false;
+    bool redraw_requested = true;
+    Uint32 redraw_deadline = 0; // 0 when no redraw is scheduled
 };
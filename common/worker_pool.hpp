@@ -0,0 +1,110 @@
+#pragma once
+#include <algorithm>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/*
+    A fixed set of threads that run one job at a time alongside the calling thread. run() hands
+    the job to every thread with its index (the caller is 0) and returns once all of them are
+    done with it, the job splits the work itself, usually by handing out indices from an atomic
+    counter. Idle workers sleep until the next run.
+*/
+class WorkerPool {
+public:
+    typedef std::function<void(std::size_t thread)> Job;
+
+    // `threads` counts the caller, 0 uses every core.
+    explicit WorkerPool(std::size_t threads = 0) {
+        set_threads(threads);
+    }
+
+    WorkerPool(const WorkerPool&) = delete;
+    void operator=(const WorkerPool&) = delete;
+
+    ~WorkerPool() {
+        stop();
+    }
+
+    void set_threads(std::size_t threads) {
+        if (threads == 0) {
+            threads = std::max(std::thread::hardware_concurrency(), 1u);
+        }
+        if (threads == get_threads()) {
+            return;
+        }
+
+        stop();
+        running = true;
+        for (std::size_t i = 1; i < threads; ++i) {
+            workers.emplace_back([this, i, seen = generation]() { loop(i, seen); });
+        }
+    }
+
+    std::size_t get_threads() const {
+        return workers.size() + 1;
+    }
+
+    void run(const Job& work) {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            job = &work;
+            busy = workers.size();
+            ++generation;
+        }
+        wake.notify_all();
+
+        work(0);
+
+        std::unique_lock<std::mutex> lock(mutex);
+        idle.wait(lock, [&]() { return busy == 0; });
+        job = nullptr;
+    }
+
+private:
+
+    // `seen` is the generation when the worker was started, a run may already be under way when it gets here.
+    void loop(std::size_t thread, std::uint64_t seen) {
+        std::unique_lock<std::mutex> lock(mutex);
+        while (true) {
+            wake.wait(lock, [&]() { return !running || generation != seen; });
+            if (!running) {
+                break;
+            }
+            seen = generation;
+            const Job* work = job;
+            lock.unlock();
+
+            (*work)(thread);
+
+            lock.lock();
+            if (--busy == 0) {
+                idle.notify_all();
+            }
+        }
+    }
+
+    void stop() {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            running = false;
+        }
+        wake.notify_all();
+        for (auto& worker : workers) {
+            worker.join();
+        }
+        workers.clear();
+    }
+
+    std::vector<std::thread> workers;
+    std::mutex mutex;
+    std::condition_variable wake, idle;
+
+    const Job* job = nullptr;
+    std::size_t busy = 0;
+    std::uint64_t generation = 0;
+    bool running = false;
+};
@@ -1,5 +1,7 @@
+#include <cstdlib>
 #include <memory>
 #include <window.hpp>
+#include <software_renderer.hpp>
 #include <ui/style.hpp>
 
 class Table {
@@ -175,15 +177,82 @@ private:
 
 class Editor : public EventContext {
 public:
-    void init() {
-        window.create("Editor", 1280, 720);
 
-        canvas = window.get_canvas();
+    enum class Mode {
+        windowed,
+        headless,  // no GL at all, frames are drawn on the CPU
+        offscreen  // renders to memory on a hidden window
+    };
+
+    bool init(Mode mode = Mode::windowed, bool render_thread = false, RenderProfile profile = RenderProfile::balanced) {
+        if (mode == Mode::headless) {
+            window.create_headless("Editor", 1280, 720);
+            software.reset(new SoftwareRenderer());
+            if (!software->create(1280, 720)) {
+                return false;
+            }
+            software->set_background({ 1, 1, 1, 1 });
+
+            // Replayed resizes reach the window, the frames it draws follow.
+            register_event(window.on_resize, [&](const glm::ivec2& size) { software->resize(size.x, size.y); });
+        } else if (mode == Mode::offscreen) {
+            if (!window.create_offscreen("Editor", 1280, 720, true, profile)) {
+                return false;
+            }
+        } else {
+            if (!window.create("Editor", 1280, 720, render_thread, profile)) {
+                return false;
+            }
+
+            // Nothing in the editor animates on its own, so only draw when something changes.
+            window.set_redraw_on_demand(true);
+        }
 
-        regular = canvas.load_font("regular", "OpenSans-Regular.ttf");
-        bold = canvas.load_font("bold", "OpenSans-Bold.ttf");
+        canvas = window.is_headless() ? software->get_canvas() : window.get_canvas();
+
+        // Regular is loaded up front so the first frame has text, bold streams in after it and shows in regular until its file is read.
+        if (window.is_headless()) {
+            StartupPhase phase("load fonts");
+            canvas.load_font("regular", "OpenSans-Regular.ttf");
+            canvas.load_font("bold", "OpenSans-Bold.ttf");
+        } else {
+            StartupPhase phase("load fonts");
+            canvas.load_font("regular", "OpenSans-Regular.ttf");
+            canvas.set_placeholder_font("regular");
+            window.load_font_async("bold", "OpenSans-Bold.ttf");
+
+            // Offscreen frames are compared and benchmarked, so they start with the final fonts.
+            if (mode == Mode::offscreen) {
+                window.finish_loading();
+            }
+        }
 
         register_event(window.on_quit, [&]() { running = false; });
+        register_event(window.on_close, [&]() { running = false; });
+
+        // The frame time overlay stays in the top right corner, everything moves so all of it is redrawn.
+        register_event(window.on_resize, [&](const glm::ivec2& size) {
+            profiler_bounds = get_profiler_bounds(size);
+            window.invalidate_all();
+        });
+
+        // F3 toggles the frame time overlay, F4 cycles through the render profiles, F5 detaches it into a panel.
+        register_event(window.on_keydown, [&](SDL_Keycode key) {
+            if (key == SDLK_F3) {
+                show_profiler = !show_profiler;
+                if (show_profiler) {
+                    FrameProfiler::get().set_enabled(true);
+                }
+                window.invalidate(profiler_bounds.min, profiler_bounds.max);
+            } else if (key == SDLK_F5) {
+                toggle_panel();
+            } else if (key == SDLK_F4) {
+                RenderProfile next = static_cast<RenderProfile>((static_cast<int>(window.get_render_profile()) + 1) % 3);
+                if (window.set_render_profile(next)) {
+                    printf("Render profile: %s\n", to_string(next));
+                }
+            }
+        });
 
         Style label_style;
         label_style.background = { 0, 0, 0, 0 };
@@ -196,13 +265,96 @@ public:
         json j = label_style;
         printf("label = %s\n", j.dump().c_str());
 
+        return true;
     }
 
 
     void run() {
+        {
+            StartupPhase phase("build ui");
+            build_ui();
+        }
+
+        while (running) {
+            window.process_events();
+
+            if (window.needs_redraw()) {
+                frame();
+            }
+
+            if (closing_panel) {
+                panel->close();
+                panel.reset();
+                closing_panel = false;
+            }
+            if (panel && panel->needs_redraw()) {
+                draw_panel();
+            }
+        }
+
+        if (panel) {
+            panel->close();
+        }
+    }
+
+
+    // Present at most `fps` frames a second instead of following vsync.
+    void cap_frame_rate(double fps) {
+        window.set_pacing(Pacing::capped, fps);
+    }
+
+
+    // Let the scene drop to `min_scale` of the window's resolution to keep up with the frame rate.
+    void enable_dynamic_resolution(float min_scale) {
+        window.set_dynamic_resolution(true, min_scale);
+    }
+
+
+    // Only redraw the parts of the window that changed.
+    void enable_damage_tracking() {
+        window.set_damage_tracking(true);
+    }
+
+
+    // Draw a late latched crosshair under the cursor and report input latency on exit.
+    void measure_latency() {
+        latency_marker = true;
+    }
+
+    void print_latency() {
+        window.get_input_latency().get_report().print("Input");
+        window.get_latch_latency().get_report().print("Late latch");
+    }
+
+
+    // Write the last frame an offscreen or headless editor rendered to `filename`.
+    void save_frame(const std::string& filename) {
+        if (window.is_headless()) {
+            software->save_frame(filename);
+        } else {
+            window.save_frame(filename);
+        }
+    }
+
+
+    // Record every input event of this session to `filename`.
+    void record(const std::string& filename) {
+        window.record_input(filename);
+    }
+
+
+    // Play a recorded session back as fast as possible and print the frame times.
+    void replay(const InputLog& log) {
+        build_ui();
+
+        window.replay(log, [&]() { frame(); }).print();
+    }
+
+private:
+
+    void build_ui() {
         window.set_background({ 0.8f, 0.8f, 0.8f, 1.0f });
 
-        Style label_style;
         label_style.background = { 0, 0, 0, 0 };
         label_style.fill = { 0, 0, 0, 1 };
         label_style.font = "bold";
@@ -210,7 +362,6 @@ public:
         label_style.font_align = Align::top | Align::left;
         label_style.anchor = Align::top | Align::left;
 
-        Style button_style;
         button_style.background = canvas.linear_gradient({ 0, -10 }, { 0, 10}, { 0.7f, 0.7f, 0.7f, 1.0f }, { 0.5f, 0.5f, 0.5f, 1.0f });
         button_style.fill = { 0.0f, 0.0f, 0.0f, 1.0f };
         button_style.stroke = { 0.5f, 0.5f, 0.5f, 1.0f };
@@ -221,46 +372,241 @@ public:
         button_style.font_align = Align::center | Align::middle;
         button_style.anchor = Align::center | Align::middle;
 
-        Label label("label", button_style, "Hello, world!");
+        label = std::make_shared<Label>("label", button_style, "Hello, world!");
 
-        VerticalLayout layout(ElementList{
+        layout = std::make_shared<VerticalLayout>(ElementList{
             std::make_shared<Label>("label 1", label_style, "Hello!"),
             std::make_shared<Label>("label 2", label_style, "I like pie!"),
             std::make_shared<Label>("button", button_style, "Button!")
         });
+    }
 
 
-        while (running) {
-            window.process_events();
+    // Opens the frame time graph in its own window, sharing the editor's fonts and GL context.
+    void toggle_panel() {
+        if (panel) {
+            closing_panel = true;
+            return;
+        }
+        if (!window.get_device()) {
+            printf("Panels need the editor's GL context on the main thread\n");
+            return;
+        }
 
-            window.begin_frame();
+        panel.reset(new Window());
+        if (!panel->create("Frame times", (int)panel_size.x, (int)panel_size.y, window.get_device())) {
+            panel.reset();
+            return;
+        }
+        panel->set_background({ 0.2f, 0.2f, 0.2f, 1.0f });
+        panel->set_redraw_on_demand(true);
+        FrameProfiler::get().set_enabled(true);
+
+        // A panel can't be destroyed from inside its own event, it goes after the frame.
+        register_event(panel->on_close, [&]() { closing_panel = true; });
+        register_event(panel->on_resize, [&](const glm::ivec2& size) { panel_size = size; });
+    }
 
-            label.draw(canvas, { { 50, 50 }, { 150, 100 } });
+    static Rectangle get_profiler_bounds(const glm::ivec2& window_size) {
+        return { { window_size.x - 250.0f, 10 }, { window_size.x - 10.0f, 90 } };
+    }
 
+    void draw_panel() {
+        panel->begin_frame();
+        FrameProfiler::get().draw(panel->get_canvas(), { 0, 0 }, panel_size, window.get_pacer().get_budget_ms(), "regular");
+        panel->end_frame();
+    }
 
-            layout.draw(canvas, { { 50, 150 }, { 150, 250 } });
 
-            window.end_frame();
+    void frame() {
+        // The overlay changes every frame it is shown.
+        if (show_profiler) {
+            window.invalidate(profiler_bounds.min, profiler_bounds.max);
         }
-    }
 
-private:
+        window.begin_frame();
+
+        // A headless window has no GL context, its frames go through the CPU renderer so replays still time the drawing.
+        if (window.is_headless()) {
+            software->begin_frame();
+        }
+
+        {
+            ProfileZone zone("draw");
+
+            window.draw_regions([&](const DamageRect& region) {
+                Rectangle label_bounds = { { 50, 50 }, { 150, 100 } };
+                if (region.intersects(label_bounds.min, label_bounds.max)) {
+                    label->draw(canvas, label_bounds);
+                }
+
+                // The layout never changes on its own, keep it in a layer instead of tessellating it every frame.
+                Rectangle layout_bounds = { { 50, 150 }, { 150, 250 } };
+                if (region.intersects(layout_bounds.min, layout_bounds.max)) {
+                    canvas.layer("layout", layout_bounds.min, layout_bounds.get_size(), layout_version, [&](Canvas& c) {
+                        layout->draw(c, { { 0, 0 }, layout_bounds.get_size() });
+                    });
+                }
+
+                if (show_profiler && region.intersects(profiler_bounds.min, profiler_bounds.max)) {
+                    FrameProfiler::get().draw(canvas, profiler_bounds.min, profiler_bounds.get_size(), window.get_pacer().get_budget_ms(), "regular");
+                }
+            });
+
+            if (latency_marker) {
+                auto marker = [](Canvas& c, const glm::ivec2& cursor) {
+                    glm::vec2 p = glm::vec2(cursor) + glm::vec2(0.5f);
+                    c.begin_path();
+                    c.move_to(p - glm::vec2(10, 0));
+                    c.line_to(p + glm::vec2(10, 0));
+                    c.move_to(p - glm::vec2(0, 10));
+                    c.line_to(p + glm::vec2(0, 10));
+                    c.stroke({ 1.0f, 0.0f, 0.0f, 1.0f }, 1.0f);
+                };
+
+                // Headless windows have no late pass, the cursor is already the last recorded one.
+                if (window.is_headless()) {
+                    marker(canvas, window.latch_cursor());
+                } else {
+                    window.late_latch(marker);
+                }
+            }
+        }
+
+        if (window.is_headless()) {
+            software->end_frame();
+        }
+        window.end_frame();
+
+        // The graph moves with every editor frame.
+        if (panel) {
+            panel->request_redraw();
+        }
+    }
 
     Window window;
+    std::unique_ptr<SoftwareRenderer> software; // draws the frames of a headless window
     Canvas canvas;
 
-    Font regular, bold;
+    Style label_style, button_style;
+    std::shared_ptr<Label> label;
+    std::shared_ptr<VerticalLayout> layout;
+    std::uint64_t layout_version = 0; // bump whenever the layout's content changes
 
     bool running = true;
+    bool show_profiler = false;
+    bool latency_marker = false;
+
+    std::unique_ptr<Window> panel;
+    glm::vec2 panel_size = { 400, 150 };
+    bool closing_panel = false;
+    Rectangle profiler_bounds = get_profiler_bounds({ 1280, 720 });
 
 };
 
 
 int main(int argc, char** argv) {
+    // Startup is timed from here to the first frame.
+    StartupTrace::get();
+
+    std::string record_file, replay_file, trace_file, screenshot_file;
+    double fps_cap = 0.0;
+    float min_scale = 0.0f;
+    bool render_thread = false, offscreen = false, damage_tracking = false, latency = false;
+    RenderProfile profile = RenderProfile::balanced;
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (arg == "--render-thread") {
+            render_thread = true;
+        } else if (arg == "--offscreen") {
+            offscreen = true;
+        } else if (arg == "--damage-tracking") {
+            damage_tracking = true;
+        } else if (arg == "--latency") {
+            latency = true;
+        } else if (i + 1 == argc) {
+            break;
+        } else if (arg == "--record") {
+            record_file = argv[++i];
+        } else if (arg == "--replay") {
+            replay_file = argv[++i];
+        } else if (arg == "--trace") {
+            trace_file = argv[++i];
+        } else if (arg == "--dynamic-resolution") {
+            min_scale = (float)atof(argv[++i]);
+        } else if (arg == "--screenshot") {
+            screenshot_file = argv[++i];
+        } else if (arg == "--fps") {
+            fps_cap = atof(argv[++i]);
+        } else if (arg == "--profile") {
+            if (!from_string(argv[++i], profile)) {
+                printf("Unknown render profile '%s', expected performance, balanced or quality\n", argv[i]);
+                return 1;
+            }
+        }
+    }
+
     Editor app;
 
-    app.init();
+    // Profile the whole session and write it out as a Chrome trace on exit.
+    if (!trace_file.empty()) {
+        FrameProfiler::get().set_enabled(true);
+    }
+
+    if (!replay_file.empty()) {
+        InputLog log;
+        if (!log.load(replay_file)) {
+            return 1;
+        }
+
+        // Replays render every frame, offscreen through GL on a hidden window, headless on the CPU for machines without a GPU.
+        if (!app.init(offscreen ? Editor::Mode::offscreen : Editor::Mode::headless, false, profile)) {
+            return 1;
+        }
+        app.replay(log);
+
+        if (!screenshot_file.empty()) {
+            app.save_frame(screenshot_file);
+        }
+
+        if (!trace_file.empty()) {
+            FrameProfiler::get().write_chrome_trace(trace_file);
+        }
+        return 0;
+    }
+
+    if (!app.init(Editor::Mode::windowed, render_thread, profile)) {
+        return 1;
+    }
+    if (fps_cap > 0.0) {
+        app.cap_frame_rate(fps_cap);
+    }
+    if (min_scale > 0.0f) {
+        app.enable_dynamic_resolution(min_scale);
+    }
+    if (damage_tracking) {
+        app.enable_damage_tracking();
+    }
+    if (!record_file.empty()) {
+        app.record(record_file);
+    }
+    if (latency) {
+        app.measure_latency();
+    }
     app.run();
 
+    if (latency) {
+        app.print_latency();
+    }
+
+    if (!trace_file.empty()) {
+        FrameProfiler::get().write_chrome_trace(trace_file);
+    }
+
+#ifdef EVENT_PROFILING
+    json events = EventProfiler::get().snapshot();
+    std::ofstream("event_profile.json") << events.dump(4);
+#endif
+
     return 0;
 }